@@ -0,0 +1,225 @@
+#include "assetarchive.h"
+#include "cookedfile.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+static const char ArchiveMagic[8] = { 'A', 'S', 'S', 'E', 'T', 'P', 'A', 'K' };
+static const unsigned int ArchiveVersion = 2;
+static const size_t AssetAlignment = 16;
+
+/*=================================================================================================
+  CONSTRUCTORS
+=================================================================================================*/
+
+AssetArchive::AssetArchive()
+{
+	Entries = nullptr;
+	Names = nullptr;
+	Count = 0;
+}
+
+/*=================================================================================================
+  OPEN / CLOSE
+=================================================================================================*/
+
+bool AssetArchive::Open( const std::string& path )
+{
+	Close();
+
+	if( !File.Open( path ) || File.GetSize() < sizeof( AssetArchiveHeader ) )
+	{
+		File.Close();
+		return false;
+	}
+
+	AssetArchiveHeader header;
+	memcpy( &header, File.GetData(), sizeof( header ) );
+	size_t namesStart = sizeof( header ) + (size_t)header.count * sizeof( AssetEntry );
+	if( memcmp( header.magic, ArchiveMagic, sizeof( ArchiveMagic ) ) != 0 || header.version != ArchiveVersion
+		|| namesStart + header.namesSize > File.GetSize() || ( header.namesSize > 0 && File.GetData()[namesStart + header.namesSize - 1] != 0 ) )
+	{
+		File.Close();
+		return false;
+	}
+
+	const AssetEntry* entries = (const AssetEntry*)( File.GetData() + sizeof( header ) );
+	for( unsigned int i = 0; i < header.count; i++ )
+	{
+		if( entries[i].offset > File.GetSize() || entries[i].size > File.GetSize() - entries[i].offset || entries[i].nameOffset >= header.namesSize )
+		{
+			File.Close();
+			return false;
+		}
+	}
+
+	Entries = entries;
+	Names = (const char*)( File.GetData() + namesStart );
+	Count = header.count;
+	return true;
+}
+
+void AssetArchive::Close( void )
+{
+	File.Close();
+	Entries = nullptr;
+	Names = nullptr;
+	Count = 0;
+}
+
+/*=================================================================================================
+  FIND
+=================================================================================================*/
+
+unsigned long long AssetArchive::GetID( const std::string& path )
+{
+	std::string name = path;
+	std::replace( name.begin(), name.end(), '\\', '/' );
+	while( name.compare( 0, 2, "./" ) == 0 )
+		name.erase( 0, 2 );
+
+	return HashBytes( name.data(), name.size() );
+}
+
+const AssetEntry* AssetArchive::FindEntry( unsigned long long id ) const
+{
+	const AssetEntry* end = Entries + Count;
+	const AssetEntry* entry = std::lower_bound( Entries, end, id, []( const AssetEntry& e, unsigned long long value ) { return e.id < value; } );
+	return entry != end && entry->id == id ? entry : nullptr;
+}
+
+const unsigned char* AssetArchive::Find( unsigned long long id, AssetType type, size_t& size ) const
+{
+	const AssetEntry* entry = FindEntry( id );
+	if( entry == nullptr || entry->type != (unsigned int)type )
+		return nullptr;
+
+	// Archives can also ship without their sources; only a source that is present can be newer
+	const char* name = Names + entry->nameOffset;
+	unsigned long long sourceSize, sourceTime;
+	if( GetSourceStamp( name, sourceSize, sourceTime ) && ( sourceSize != entry->sourceSize || sourceTime != entry->sourceTime ) )
+	{
+		std::cout << "Asset " << name << " changed since it was cooked, loading it from disk" << std::endl;
+		return nullptr;
+	}
+
+	size = (size_t)entry->size;
+	return GetData( *entry );
+}
+
+bool AssetArchive::GetSourceStamp( const std::string& path, unsigned long long& size, unsigned long long& time )
+{
+#ifdef _WIN32
+	struct _stat64 info;
+	if( _stat64( path.c_str(), &info ) != 0 )
+		return false;
+#else
+	struct stat info;
+	if( stat( path.c_str(), &info ) != 0 )
+		return false;
+#endif
+
+	size = (unsigned long long)info.st_size;
+	time = (unsigned long long)info.st_mtime;
+	return true;
+}
+
+/*=================================================================================================
+  WRITER
+=================================================================================================*/
+
+void AssetArchiveWriter::Add( const std::string& path, AssetType type, unsigned long long sourceHash, unsigned long long sourceSize, unsigned long long sourceTime,
+	const unsigned char* data, size_t size )
+{
+	Asset asset;
+	asset.path = path;
+	asset.entry = AssetEntry{ AssetArchive::GetID( path ), sourceHash, sourceSize, sourceTime, 0, size, (unsigned int)type, 0 };
+	asset.data.assign( data, data + size );
+	Assets.push_back( std::move( asset ) );
+}
+
+bool AssetArchiveWriter::Save( const std::string& path ) const
+{
+	std::vector<const Asset*> sorted;
+	for( const Asset& asset : Assets )
+		sorted.push_back( &asset );
+	std::sort( sorted.begin(), sorted.end(), []( const Asset* a, const Asset* b ) { return a->entry.id < b->entry.id; } );
+
+	std::vector<AssetEntry> entries;
+	std::string names;
+	for( const Asset* asset : sorted )
+	{
+		AssetEntry entry = asset->entry;
+		entry.nameOffset = (unsigned int)names.size();
+		names += asset->path;
+		names += '\0';
+		entries.push_back( entry );
+	}
+
+	AssetArchiveHeader header = {};
+	memcpy( header.magic, ArchiveMagic, sizeof( ArchiveMagic ) );
+	header.version = ArchiveVersion;
+	header.count = (unsigned int)entries.size();
+	header.namesSize = (unsigned int)names.size();
+
+	// Lay the assets out after the index, each on an aligned offset so it can be used in place
+	size_t offset = sizeof( header ) + entries.size() * sizeof( AssetEntry ) + names.size();
+	for( AssetEntry& entry : entries )
+	{
+		offset = ( offset + AssetAlignment - 1 ) / AssetAlignment * AssetAlignment;
+		entry.offset = offset;
+		offset += (size_t)entry.size;
+	}
+
+	std::ofstream file( path, std::ios::binary | std::ios::trunc );
+	if( !file )
+		return false;
+
+	file.write( (const char*)&header, sizeof( header ) );
+	file.write( (const char*)entries.data(), entries.size() * sizeof( AssetEntry ) );
+	file.write( names.data(), names.size() );
+
+	static const char padding[AssetAlignment] = {};
+	size_t written = sizeof( header ) + entries.size() * sizeof( AssetEntry ) + names.size();
+	for( size_t i = 0; i < sorted.size(); i++ )
+	{
+		file.write( padding, (size_t)entries[i].offset - written );
+		file.write( (const char*)sorted[i]->data.data(), sorted[i]->data.size() );
+		written = (size_t)( entries[i].offset + entries[i].size );
+	}
+
+	return (bool)file;
+}
+
+/*=================================================================================================
+  TEXTURES
+=================================================================================================*/
+
+bool UploadCookedTexture( GLenum target, const unsigned char* data, size_t size )
+{
+	AssetTextureHeader header;
+	if( size < sizeof( header ) )
+		return false;
+	memcpy( &header, data, sizeof( header ) );
+
+	size_t offset = sizeof( header );
+	unsigned int width = header.width, height = header.height;
+	for( unsigned int level = 0; level < header.levels; level++ )
+	{
+		size_t levelSize = (size_t)width * height * 4;
+		if( levelSize > size - offset )
+			return false;
+
+		glTexImage2D( target, level, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data + offset );
+		offset += levelSize;
+		width = std::max( 1u, width / 2 );
+		height = std::max( 1u, height / 2 );
+	}
+
+	GLenum bindTarget = target == GL_TEXTURE_2D ? GL_TEXTURE_2D : GL_TEXTURE_CUBE_MAP;
+	glTexParameteri( bindTarget, GL_TEXTURE_MAX_LEVEL, header.levels > 0 ? header.levels - 1 : 0 );
+	return header.levels > 0;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+#include "mappedfile.h"
+
+enum AssetType
+{
+	ASSET_TEXTURE = 1,	// AssetTextureHeader, then the RGBA8 pixels of every mip level
+	ASSET_MODEL   = 2,	// the same blob as a .cooked model cache
+	ASSET_SHADER  = 3	// shader source text
+};
+
+// File layout: AssetArchiveHeader, the entries sorted by ID, the names, then the 16-byte aligned assets
+struct AssetArchiveHeader
+{
+	char magic[8];
+	unsigned int version;
+	unsigned int count;
+	unsigned int namesSize;
+	unsigned int reserved;
+};
+
+struct AssetEntry
+{
+	unsigned long long id;			// AssetArchive::GetID of the asset's path
+	unsigned long long sourceHash;	// source file and cooker version the asset was made from
+	unsigned long long sourceSize;	// size and modification time of the source when it was cooked
+	unsigned long long sourceTime;
+	unsigned long long offset;		// from the start of the file
+	unsigned long long size;
+	unsigned int type;				// AssetType
+	unsigned int nameOffset;		// into the names
+};
+
+struct AssetTextureHeader
+{
+	unsigned int width;
+	unsigned int height;
+	unsigned int levels;
+	unsigned int reserved;
+};
+
+// Read-only view of an archive made by AssetArchiveWriter. The file is mapped, and assets are used in place.
+class AssetArchive
+{
+public:
+	AssetArchive();
+
+	AssetArchive( const AssetArchive& ) = delete;
+	AssetArchive& operator=( const AssetArchive& ) = delete;
+
+public:
+	/**
+	Maps an archive and checks its index.
+	*@param path Archive file.
+	*@return True if the file is a valid archive of the current version.
+	**/
+	bool Open( const std::string& path );
+	void Close();
+
+	// Hash of a path with "./" prefixes dropped and '\' turned into '/', so every spelling finds the same asset
+	static unsigned long long GetID( const std::string& path );
+
+	/**
+	Looks an asset up by ID with a binary search over the mapped index. An asset whose source file is on disk
+	with another size or modification time than it was cooked from is stale: it is skipped with a message,
+	so the caller loads the edited file instead.
+	*@param type Expected type; assets of another type are not returned.
+	*@param size Receives the asset size.
+	*@return The asset bytes, valid until Close, or nullptr if the archive has no current asset of that type.
+	**/
+	const unsigned char* Find( unsigned long long id, AssetType type, size_t& size ) const;
+	const unsigned char* Find( const std::string& path, AssetType type, size_t& size ) const { return Find( GetID( path ), type, size ); }
+
+	// Index lookup without the staleness check
+	const AssetEntry* FindEntry( unsigned long long id ) const;
+
+	/**
+	Reads the size and modification time of a source file, as recorded in AssetEntry.
+	*@return False if the file does not exist.
+	**/
+	static bool GetSourceStamp( const std::string& path, unsigned long long& size, unsigned long long& time );
+
+public:
+	bool              IsOpen()       const { return Entries != nullptr; }
+	int               GetNumAssets() const { return (int)Count; }
+	size_t            GetSize()      const { return File.GetSize(); }
+	const AssetEntry& GetEntry( int i ) const { return Entries[i]; }
+	const char*       GetName( int i )  const { return Names + Entries[i].nameOffset; }
+	const unsigned char* GetData( const AssetEntry& entry ) const { return File.GetData() + entry.offset; }
+
+private:
+	MappedFile File;
+	const AssetEntry* Entries;
+	const char* Names;
+	unsigned int Count;
+};
+
+// Collects assets in memory and writes them as an archive
+class AssetArchiveWriter
+{
+public:
+	void Add( const std::string& path, AssetType type, unsigned long long sourceHash, unsigned long long sourceSize, unsigned long long sourceTime,
+		const unsigned char* data, size_t size );
+
+	/**
+	Writes the archive, replacing the file.
+	*@param path Output file; must not be mapped by an open AssetArchive.
+	*@return True if the whole file was written.
+	**/
+	bool Save( const std::string& path ) const;
+
+	int GetNumAssets() const { return (int)Assets.size(); }
+
+private:
+	struct Asset
+	{
+		std::string path;
+		AssetEntry entry;
+		std::vector<unsigned char> data;
+	};
+
+	std::vector<Asset> Assets;
+};
+
+/**
+Uploads a cooked texture into the texture bound to target, with all of its mip levels.
+*@param target GL_TEXTURE_2D, or a face of the bound cube map.
+*@return True if the data is a valid cooked texture.
+**/
+bool UploadCookedTexture( GLenum target, const unsigned char* data, size_t size );
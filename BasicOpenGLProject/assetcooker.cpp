@@ -0,0 +1,244 @@
+#include "assetcooker.h"
+#include "cookedfile.h"
+#include "mappedfile.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cctype>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+// Appends the paths of all files below directory
+static void ListFiles( const std::string& directory, std::vector<std::string>& files )
+{
+#ifdef _WIN32
+	WIN32_FIND_DATAA found;
+	HANDLE find = FindFirstFileA( ( directory + "/*" ).c_str(), &found );
+	if( find == INVALID_HANDLE_VALUE )
+		return;
+
+	do
+	{
+		std::string name = found.cFileName;
+		if( name == "." || name == ".." )
+			continue;
+
+		if( found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
+			ListFiles( directory + "/" + name, files );
+		else
+			files.push_back( directory + "/" + name );
+	} while( FindNextFileA( find, &found ) );
+
+	FindClose( find );
+#else
+	DIR* dir = opendir( directory.c_str() );
+	if( dir == nullptr )
+		return;
+
+	while( dirent* found = readdir( dir ) )
+	{
+		std::string name = found->d_name;
+		if( name == "." || name == ".." )
+			continue;
+
+		std::string path = directory + "/" + name;
+		struct stat info;
+		if( stat( path.c_str(), &info ) != 0 )
+			continue;
+
+		if( S_ISDIR( info.st_mode ) )
+			ListFiles( path, files );
+		else
+			files.push_back( path );
+	}
+
+	closedir( dir );
+#endif
+}
+
+/*=================================================================================================
+  CONSTRUCTORS
+=================================================================================================*/
+
+AssetCooker::AssetCooker()
+{
+	const char* textures[] = { ".png", ".jpg", ".jpeg", ".tga", ".bmp" };
+	for( const char* extension : textures )
+		AddType( extension, ASSET_TEXTURE, 1, CookTexture );
+
+	const char* shaders[] = { ".vert", ".frag", ".geom", ".glsl" };
+	for( const char* extension : shaders )
+		AddType( extension, ASSET_SHADER, 1, CookShader );
+}
+
+/*=================================================================================================
+  SETUP
+=================================================================================================*/
+
+void AssetCooker::AddType( const std::string& extension, AssetType type, unsigned int version, CookFunction cook )
+{
+	Handlers.push_back( Handler{ extension, type, version, cook } );
+}
+
+void AssetCooker::AddDirectory( const std::string& directory )
+{
+	std::vector<std::string> files;
+	ListFiles( directory, files );
+
+	// Directory order differs between systems; sort so archives come out the same everywhere
+	std::sort( files.begin(), files.end() );
+	for( const std::string& file : files )
+	{
+		if( FindHandler( file ) != nullptr )
+			Files.push_back( file );
+	}
+}
+
+const AssetCooker::Handler* AssetCooker::FindHandler( const std::string& path ) const
+{
+	size_t dot = path.find_last_of( '.' );
+	if( dot == std::string::npos )
+		return nullptr;
+
+	std::string extension = path.substr( dot );
+	std::transform( extension.begin(), extension.end(), extension.begin(), []( char c ) { return (char)tolower( c ); } );
+
+	for( const Handler& handler : Handlers )
+	{
+		if( handler.extension == extension )
+			return &handler;
+	}
+	return nullptr;
+}
+
+/*=================================================================================================
+  COOK
+=================================================================================================*/
+
+bool AssetCooker::Cook( const std::string& archivePath )
+{
+	auto start = std::chrono::steady_clock::now();
+
+	AssetArchive previous;
+	previous.Open( archivePath );
+
+	AssetArchiveWriter writer;
+	int rebuilt = 0, failed = 0;
+	size_t bytes = 0;
+	for( const std::string& path : Files )
+	{
+		const Handler* handler = FindHandler( path );
+
+		MappedFile source;
+		if( !source.Open( path ) )
+		{
+			std::cerr << "Cannot open asset " << path << std::endl;
+			failed++;
+			continue;
+		}
+
+		unsigned long long sourceHash = HashBytes( source.GetData(), source.GetSize() );
+		sourceHash = HashBytes( &handler->version, sizeof( handler->version ), sourceHash );
+
+		// Recorded even for reused assets, so a source that was only touched does not read as stale
+		unsigned long long sourceSize = 0, sourceTime = 0;
+		AssetArchive::GetSourceStamp( path, sourceSize, sourceTime );
+
+		const AssetEntry* old = previous.IsOpen() ? previous.FindEntry( AssetArchive::GetID( path ) ) : nullptr;
+		if( old != nullptr && old->sourceHash == sourceHash && old->type == (unsigned int)handler->type )
+		{
+			writer.Add( path, handler->type, sourceHash, sourceSize, sourceTime, previous.GetData( *old ), (size_t)old->size );
+			bytes += (size_t)old->size;
+			continue;
+		}
+
+		std::vector<unsigned char> cooked;
+		if( !handler->cook( path, source.GetData(), source.GetSize(), cooked ) )
+		{
+			std::cerr << "Cannot cook asset " << path << std::endl;
+			failed++;
+			continue;
+		}
+
+		std::cout << "  cooked " << path << " (" << cooked.size() / 1024 << " KB)\n";
+		writer.Add( path, handler->type, sourceHash, sourceSize, sourceTime, cooked.data(), cooked.size() );
+		bytes += cooked.size();
+		rebuilt++;
+	}
+
+	// The writer holds its own copies; unmap the old archive so the file can be replaced
+	previous.Close();
+	bool saved = writer.Save( archivePath );
+
+	double ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+	std::cout << "Assets: " << writer.GetNumAssets() << " in " << archivePath << " (" << bytes / 1024 << " KB), "
+		<< rebuilt << " cooked, " << writer.GetNumAssets() - rebuilt << " unchanged, " << failed << " failed, " << ms << " ms" << std::endl;
+	if( !saved )
+		std::cerr << "Cannot write " << archivePath << std::endl;
+
+	return saved && failed == 0;
+}
+
+/*=================================================================================================
+  CONVERTERS
+=================================================================================================*/
+
+bool AssetCooker::CookTexture( const std::string& path, const unsigned char* data, size_t size, std::vector<unsigned char>& cooked )
+{
+	int width, height, channels;
+	unsigned char* pixels = stbi_load_from_memory( data, (int)size, &width, &height, &channels, STBI_rgb_alpha );
+	if( pixels == nullptr )
+		return false;
+
+	AssetTextureHeader header = { (unsigned int)width, (unsigned int)height, 1, 0 };
+	std::vector<unsigned char> level( pixels, pixels + (size_t)width * height * 4 );
+	stbi_image_free( pixels );
+
+	cooked.resize( sizeof( header ) );
+	cooked.insert( cooked.end(), level.begin(), level.end() );
+
+	// Each level averages 2x2 texels of the one above; odd edges repeat their last texel
+	while( width > 1 || height > 1 )
+	{
+		int nextWidth = std::max( 1, width / 2 ), nextHeight = std::max( 1, height / 2 );
+		std::vector<unsigned char> next( (size_t)nextWidth * nextHeight * 4 );
+		for( int y = 0; y < nextHeight; y++ )
+		{
+			int y0 = std::min( y * 2, height - 1 ), y1 = std::min( y * 2 + 1, height - 1 );
+			for( int x = 0; x < nextWidth; x++ )
+			{
+				int x0 = std::min( x * 2, width - 1 ), x1 = std::min( x * 2 + 1, width - 1 );
+				for( int c = 0; c < 4; c++ )
+				{
+					int sum = level[( (size_t)y0 * width + x0 ) * 4 + c] + level[( (size_t)y0 * width + x1 ) * 4 + c]
+						+ level[( (size_t)y1 * width + x0 ) * 4 + c] + level[( (size_t)y1 * width + x1 ) * 4 + c];
+					next[( (size_t)y * nextWidth + x ) * 4 + c] = (unsigned char)( ( sum + 2 ) / 4 );
+				}
+			}
+		}
+
+		cooked.insert( cooked.end(), next.begin(), next.end() );
+		level.swap( next );
+		width = nextWidth;
+		height = nextHeight;
+		header.levels++;
+	}
+
+	memcpy( cooked.data(), &header, sizeof( header ) );
+	return true;
+}
+
+bool AssetCooker::CookShader( const std::string& path, const unsigned char* data, size_t size, std::vector<unsigned char>& cooked )
+{
+	cooked.assign( data, data + size );
+	return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "assetarchive.h"
+
+// Converts the files under a set of directories into their GPU-ready form and packs them into one
+// AssetArchive. Assets whose source and cooker version are unchanged are copied from the previous archive.
+class AssetCooker
+{
+public:
+	/**
+	Converts one source file.
+	*@param path Path of the source, used for error messages and names derived from it.
+	*@param data Contents of the source file.
+	*@param cooked Receives the asset.
+	*@return False if the source could not be converted; the asset is left out.
+	**/
+	typedef bool ( *CookFunction )( const std::string& path, const unsigned char* data, size_t size, std::vector<unsigned char>& cooked );
+
+	// Registers the texture and shader extensions
+	AssetCooker();
+
+public:
+	/**
+	Cooks files with an extension into assets of a type.
+	*@param extension Lower-case extension including the dot, e.g. ".glb".
+	*@param version Part of every source hash; bump it to recook all assets of the type.
+	**/
+	void AddType( const std::string& extension, AssetType type, unsigned int version, CookFunction cook );
+
+	// Adds every file below a directory, recursively; files without a registered extension are skipped
+	void AddDirectory( const std::string& directory );
+
+	/**
+	Cooks the added files and writes the archive.
+	*@param archivePath Archive to write. Its current contents are reused for unchanged sources.
+	*@return True if every file was cooked and the archive was written.
+	**/
+	bool Cook( const std::string& archivePath );
+
+	// RGBA8 pixels with a box-filtered mip chain
+	static bool CookTexture( const std::string& path, const unsigned char* data, size_t size, std::vector<unsigned char>& cooked );
+
+	// The source text as is
+	static bool CookShader( const std::string& path, const unsigned char* data, size_t size, std::vector<unsigned char>& cooked );
+
+private:
+	struct Handler
+	{
+		std::string extension;
+		AssetType type;
+		unsigned int version;
+		CookFunction cook;
+	};
+
+	const Handler* FindHandler( const std::string& path ) const;
+
+private:
+	std::vector<Handler> Handlers;
+	std::vector<std::string> Files;
+};
@@ -0,0 +1,90 @@
+#include "cookedfile.h"
+#include <algorithm>
+#include <fstream>
+
+static const size_t ArrayAlignment = 16;
+
+/*=================================================================================================
+  HASH
+=================================================================================================*/
+
+unsigned long long HashBytes( const void* data, size_t size, unsigned long long seed )
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	unsigned long long hash = seed;
+	for( size_t i = 0; i < size; i++ )
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/*=================================================================================================
+  WRITER
+=================================================================================================*/
+
+void CookedWriter::WriteString( const std::string& value )
+{
+	Write( (unsigned int)value.size() );
+	Append( value.data(), value.size() );
+}
+
+bool CookedWriter::Save( const std::string& path ) const
+{
+	std::ofstream file( path, std::ios::binary | std::ios::trunc );
+	if( !file )
+		return false;
+
+	file.write( Buffer.data(), Buffer.size() );
+	return (bool)file;
+}
+
+void CookedWriter::Append( const void* data, size_t size )
+{
+	const char* bytes = (const char*)data;
+	Buffer.insert( Buffer.end(), bytes, bytes + size );
+}
+
+void CookedWriter::Align( void )
+{
+	Buffer.resize( ( Buffer.size() + ArrayAlignment - 1 ) / ArrayAlignment * ArrayAlignment, 0 );
+}
+
+/*=================================================================================================
+  READER
+=================================================================================================*/
+
+CookedReader::CookedReader( const void* data, size_t size )
+{
+	Data = (const char*)data;
+	Size = size;
+	Offset = 0;
+	Failed = false;
+}
+
+bool CookedReader::ReadString( std::string& value )
+{
+	unsigned int length;
+	if( !Read( length ) || !Check( length ) )
+		return false;
+
+	value.assign( Data + Offset, length );
+	Offset += length;
+	return true;
+}
+
+bool CookedReader::Check( size_t size )
+{
+	if( Failed || size > Size - Offset )
+	{
+		Failed = true;
+		return false;
+	}
+	return true;
+}
+
+void CookedReader::Align( void )
+{
+	Offset = std::min( Size, ( Offset + ArrayAlignment - 1 ) / ArrayAlignment * ArrayAlignment );
+}
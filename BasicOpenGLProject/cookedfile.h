@@ -0,0 +1,95 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstddef>
+
+// 64-bit FNV-1a; chain calls by passing the previous result as seed
+unsigned long long HashBytes( const void* data, size_t size, unsigned long long seed = 14695981039346656037ULL );
+
+// Builds a cooked file in memory. Arrays are 16-byte aligned so a reader can use them in place.
+class CookedWriter
+{
+public:
+	template<typename T>
+	void Write( const T& value )
+	{
+		Append( &value, sizeof( T ) );
+	}
+
+	// Writes count elements without a length prefix; write the count first
+	template<typename T>
+	void WriteArray( const T* data, size_t count )
+	{
+		Align();
+		Append( data, sizeof( T ) * count );
+	}
+
+	void WriteString( const std::string& value );
+
+	/**
+	Writes the buffer to disk.
+	*@param path Output file.
+	*@return True if the whole file was written.
+	**/
+	bool Save( const std::string& path ) const;
+
+	const char* GetData() const { return Buffer.data();  }
+	size_t      GetSize() const { return Buffer.size(); }
+
+private:
+	void Append( const void* data, size_t size );
+	void Align();
+
+private:
+	std::vector<char> Buffer;
+};
+
+// Reads a file made by CookedWriter, in the order it was written, without copying arrays
+class CookedReader
+{
+public:
+	CookedReader( const void* data, size_t size );
+
+	template<typename T>
+	bool Read( T& value )
+	{
+		if( !Check( sizeof( T ) ) )
+			return false;
+		memcpy( &value, Data + Offset, sizeof( T ) );
+		Offset += sizeof( T );
+		return true;
+	}
+
+	/**
+	Returns count elements in place; the pointer stays valid as long as the underlying memory.
+	*@param count Number of elements.
+	*@return Pointer to the first element, or nullptr if the data is truncated.
+	**/
+	template<typename T>
+	const T* ReadArray( size_t count )
+	{
+		Align();
+		if( !Check( sizeof( T ) * count ) )
+			return nullptr;
+		const T* data = (const T*)( Data + Offset );
+		Offset += sizeof( T ) * count;
+		return data;
+	}
+
+	bool ReadString( std::string& value );
+
+	// False once any read ran past the end of the data
+	bool IsValid() const { return !Failed; }
+
+private:
+	bool Check( size_t size );
+	void Align();
+
+private:
+	const char* Data;
+	size_t Size;
+	size_t Offset;
+	bool Failed;
+};
@@ -0,0 +1,193 @@
+#include "framepacer.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <GL/wglew.h>
+#else
+#include <GL/glxew.h>
+#include <ctime>
+#endif
+
+/*=================================================================================================
+  CONSTRUCTORS
+=================================================================================================*/
+
+FramePacer::FramePacer()
+{
+	Mode = PACE_LIMITED;
+	TargetRate = 60.0;
+	SpinTail = 0.002;
+
+	NextDeadline = Clock::now();
+	HasLastFrame = false;
+
+	Intervals.assign( 4096, 0.0f );
+
+	ResetStats();
+}
+
+/*=================================================================================================
+  SET MODE
+=================================================================================================*/
+
+void FramePacer::SetMode( PacingMode mode, double targetRate )
+{
+	Mode = mode;
+	TargetRate = targetRate > 0.0 ? targetRate : 60.0;
+	NextDeadline = Clock::now();
+
+	SetSwapInterval( Mode == PACE_VSYNC ? 1 : 0 );
+	ResetStats();
+}
+
+void FramePacer::SetSwapInterval( int interval )
+{
+#ifdef _WIN32
+	if( WGLEW_EXT_swap_control )
+		wglSwapIntervalEXT( interval );
+#else
+	if( GLXEW_MESA_swap_control )
+		glXSwapIntervalMESA( (unsigned int)interval );
+	else if( GLXEW_SGI_swap_control && interval > 0 )
+		glXSwapIntervalSGI( interval );
+#endif
+}
+
+/*=================================================================================================
+  WAIT
+=================================================================================================*/
+
+void FramePacer::WaitForNextFrame( void )
+{
+	if( Mode != PACE_LIMITED )
+		return;
+
+	Clock::duration period = std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( 1.0 / TargetRate ) );
+	Clock::duration spin = std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( SpinTail ) );
+
+	NextDeadline += period;
+
+	// After a stall, start over from now instead of rendering a burst of catch-up frames
+	Clock::time_point now = Clock::now();
+	if( now > NextDeadline + period )
+		NextDeadline = now + period;
+
+	if( NextDeadline - now > spin )
+		std::this_thread::sleep_until( NextDeadline - spin );
+
+	while( Clock::now() < NextDeadline )
+		std::this_thread::yield();
+}
+
+/*=================================================================================================
+  STATISTICS
+=================================================================================================*/
+
+void FramePacer::FrameFinished( void )
+{
+	Clock::time_point now = Clock::now();
+
+	if( HasLastFrame )
+	{
+		Intervals[NextInterval] = std::chrono::duration<float>( now - LastFrame ).count();
+		NextInterval = ( NextInterval + 1 ) % (int)Intervals.size();
+		NumFrames++;
+	}
+
+	LastFrame = now;
+	HasLastFrame = true;
+}
+
+void FramePacer::ResetStats( void )
+{
+	NextInterval = 0;
+	NumFrames = 0;
+	HasLastFrame = false;
+	StatsStart = Clock::now();
+	StatsCpuStart = ProcessCpuSeconds();
+}
+
+double FramePacer::GetIntervalPercentile( double percentile ) const
+{
+	int count = std::min( NumFrames, (int)Intervals.size() );
+	if( count == 0 )
+		return 0.0;
+
+	std::vector<float> sorted( Intervals.begin(), Intervals.begin() + count );
+	int index = std::min( count - 1, (int)( percentile / 100.0 * count ) );
+	std::nth_element( sorted.begin(), sorted.begin() + index, sorted.end() );
+
+	return sorted[index];
+}
+
+double FramePacer::GetMeanInterval( void ) const
+{
+	int count = std::min( NumFrames, (int)Intervals.size() );
+	if( count == 0 )
+		return 0.0;
+
+	double sum = 0.0;
+	for( int i = 0; i < count; i++ )
+		sum += Intervals[i];
+
+	return sum / count;
+}
+
+// Standard deviation of the frame interval
+double FramePacer::GetIntervalJitter( void ) const
+{
+	int count = std::min( NumFrames, (int)Intervals.size() );
+	if( count == 0 )
+		return 0.0;
+
+	double mean = GetMeanInterval();
+	double sum = 0.0;
+	for( int i = 0; i < count; i++ )
+		sum += ( Intervals[i] - mean ) * ( Intervals[i] - mean );
+
+	return std::sqrt( sum / count );
+}
+
+void FramePacer::PrintStats( std::ostream& out ) const
+{
+	const char* modes[] = { "limited", "vsync", "unlimited" };
+
+	double wall = std::chrono::duration<double>( Clock::now() - StatsStart ).count();
+	double cpu = ProcessCpuSeconds() - StatsCpuStart;
+
+	out << "Frame pacing (" << modes[Mode];
+	if( Mode == PACE_LIMITED )
+		out << " " << TargetRate << " Hz";
+	out << "): " << NumFrames << " frames, mean " << GetMeanInterval() * 1000.0 << " ms, p50 "
+		<< GetIntervalPercentile( 50.0 ) * 1000.0 << " ms, p99 " << GetIntervalPercentile( 99.0 ) * 1000.0 << " ms, jitter "
+		<< GetIntervalJitter() * 1000.0 << " ms, CPU " << ( wall > 0.0 ? cpu / wall * 100.0 : 0.0 ) << "% of one core" << std::endl;
+}
+
+/*=================================================================================================
+  CPU TIME
+=================================================================================================*/
+
+double FramePacer::ProcessCpuSeconds( void )
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if( GetProcessTimes( GetCurrentProcess(), &creation, &exit, &kernel, &user ) == 0 )
+		return 0.0;
+
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+
+	return ( k.QuadPart + u.QuadPart ) * 100e-9;
+#else
+	timespec ts;
+	clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &ts );
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
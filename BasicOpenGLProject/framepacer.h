@@ -0,0 +1,75 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/freeglut.h>
+#include <chrono>
+#include <vector>
+#include <ostream>
+
+enum PacingMode
+{
+	PACE_LIMITED,	// sleep until the next deadline at the target rate, spin only for the last moment
+	PACE_VSYNC,		// let the buffer swap block on the display refresh
+	PACE_UNLIMITED	// render as fast as possible (benchmarking)
+};
+
+class FramePacer
+{
+public:
+	FramePacer();
+
+public:
+	/**
+	Selects how frames are paced. Call after the GL context exists, since it sets the swap interval.
+	*@param mode Pacing mode.
+	*@param targetRate Frames per second in PACE_LIMITED mode.
+	**/
+	void SetMode( PacingMode mode, double targetRate = 60.0 );
+
+	/**
+	Sets how long before a deadline the pacer stops sleeping and spins, to absorb the OS sleep granularity.
+	*@param seconds Length of the spin tail.
+	**/
+	void SetSpinTail( double seconds ) { SpinTail = seconds; }
+
+	// Blocks until the next frame is due (returns immediately in vsync and unlimited modes)
+	void WaitForNextFrame();
+
+	// Records the interval since the previous frame; call once per presented frame
+	void FrameFinished();
+
+	void ResetStats();
+	void PrintStats( std::ostream& out ) const;
+
+public:
+	PacingMode GetMode()       const { return Mode;       }
+	double     GetTargetRate() const { return TargetRate; }
+	int        GetNumFrames()  const { return NumFrames;  }
+
+	double GetIntervalPercentile( double percentile ) const;
+	double GetMeanInterval() const;
+	double GetIntervalJitter() const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	void SetSwapInterval( int interval );
+	static double ProcessCpuSeconds();
+
+private:
+	PacingMode Mode;
+	double TargetRate;
+	double SpinTail;
+
+	Clock::time_point NextDeadline;
+	Clock::time_point LastFrame;
+	bool HasLastFrame;
+
+	// Ring of the most recent frame intervals, in seconds
+	std::vector<float> Intervals;
+	int NextInterval;
+	int NumFrames;
+
+	Clock::time_point StatsStart;
+	double StatsCpuStart;
+};
@@ -0,0 +1,156 @@
+#include "gputimer.h"
+#include "profiler.h"
+#include <algorithm>
+
+/*=================================================================================================
+  CONSTRUCTORS
+=================================================================================================*/
+
+GpuTimer::GpuTimer()
+{
+	Latency = 0;
+	Frame = 0;
+	Active = -1;
+	Supported = false;
+}
+
+/*=================================================================================================
+  CREATE
+=================================================================================================*/
+
+void GpuTimer::Create( const std::vector<const char*>& passNames, int latency )
+{
+	Delete();
+
+	Supported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+	if( !Supported )
+		return;
+
+	Latency = std::max( latency, 2 );
+	Frame = 0;
+	Active = -1;
+
+	for( const char* name : passNames )
+		Passes.push_back( Pass{ name, 0.0, std::vector<float>( 256, 0.0f ), 0, 0 } );
+
+	Queries.resize( Latency * Passes.size() );
+	for( Query& query : Queries )
+	{
+		glGenQueries( 1, &query.id );
+		query.pending = false;
+	}
+}
+
+/*=================================================================================================
+  BEGIN / END
+=================================================================================================*/
+
+void GpuTimer::Begin( int pass )
+{
+	if( !Supported )
+		return;
+
+	// A query still in flight from Latency frames ago is skipped rather than waited on
+	Query& query = GetQuery( Frame, pass );
+	if( query.pending )
+	{
+		Active = -1;
+		return;
+	}
+
+	glBeginQuery( GL_TIME_ELAPSED, query.id );
+	query.pending = true;
+	Active = pass;
+}
+
+void GpuTimer::End( int pass )
+{
+	if( !Supported || Active != pass )
+		return;
+
+	glEndQuery( GL_TIME_ELAPSED );
+	Active = -1;
+}
+
+/*=================================================================================================
+  END FRAME
+=================================================================================================*/
+
+void GpuTimer::EndFrame( void )
+{
+	if( !Supported )
+		return;
+
+	// Walk the ring oldest first, so samples arrive in frame order
+	for( int age = Latency - 1; age >= 1; age-- )
+	{
+		int frame = ( Frame + Latency - age ) % Latency;
+		for( int pass = 0; pass < (int)Passes.size(); pass++ )
+		{
+			Query& query = GetQuery( frame, pass );
+			if( !query.pending )
+				continue;
+
+			GLint available = 0;
+			glGetQueryObjectiv( query.id, GL_QUERY_RESULT_AVAILABLE, &available );
+			if( !available )
+				continue;
+
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v( query.id, GL_QUERY_RESULT, &elapsed );
+			query.pending = false;
+
+			Pass& p = Passes[pass];
+			p.last = elapsed / 1000000.0;
+			p.samples[p.nextSample] = (float)p.last;
+			p.nextSample = ( p.nextSample + 1 ) % (int)p.samples.size();
+			p.numSamples = std::min( p.numSamples + 1, (int)p.samples.size() );
+
+#ifdef ENABLE_PROFILER
+			Profiler::RecordCounter( p.name, Profiler::Now(), p.last );
+#endif
+		}
+	}
+
+	Frame = ( Frame + 1 ) % Latency;
+}
+
+/*=================================================================================================
+  DELETE
+=================================================================================================*/
+
+void GpuTimer::Delete( void )
+{
+	for( Query& query : Queries )
+		glDeleteQueries( 1, &query.id );
+
+	Queries.clear();
+	Passes.clear();
+}
+
+/*=================================================================================================
+  STATISTICS
+=================================================================================================*/
+
+void GpuTimer::PrintStats( std::ostream& out ) const
+{
+	if( !Supported )
+	{
+		out << "GPU timer queries are not supported" << std::endl;
+		return;
+	}
+
+	out << "GPU passes (ms):";
+	for( const Pass& p : Passes )
+	{
+		double sum = 0.0, max = 0.0;
+		for( int i = 0; i < p.numSamples; i++ )
+		{
+			sum += p.samples[i];
+			max = std::max( max, (double)p.samples[i] );
+		}
+
+		out << " " << p.name << " mean " << ( p.numSamples > 0 ? sum / p.numSamples : 0.0 ) << " max " << max << ";";
+	}
+	out << std::endl;
+}
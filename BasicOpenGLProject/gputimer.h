@@ -0,0 +1,64 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+#include <ostream>
+
+class GpuTimer
+{
+public:
+	GpuTimer();
+
+public:
+	/**
+	Creates GL_TIME_ELAPSED queries for every pass in each of latency frames. Results are read
+	latency - 1 frames later at the earliest, and only once the driver reports them available.
+	*@param passNames Pass names, also used as profiler counter names (string literals).
+	*@param latency Number of frames in the query ring.
+	**/
+	void Create( const std::vector<const char*>& passNames, int latency = 4 );
+
+	// Starts timing a pass; passes must not overlap
+	void Begin( int pass );
+	void End( int pass );
+
+	// Collects the results that became available and moves to the next slot of the ring
+	void EndFrame();
+
+	void Delete();
+
+	// Prints the mean and maximum GPU time per pass over the recent frames
+	void PrintStats( std::ostream& out ) const;
+
+public:
+	bool IsSupported() const { return Supported; }
+
+	// Most recent GPU time of a pass, in milliseconds
+	double GetLastTime( int pass ) const { return Passes[pass].last; }
+
+private:
+	struct Pass
+	{
+		const char* name;
+		double last;
+		std::vector<float> samples;	// recent times in ms
+		int nextSample;
+		int numSamples;
+	};
+
+	struct Query
+	{
+		GLuint id;
+		bool pending;	// issued and not read back yet
+	};
+
+	Query& GetQuery( int frame, int pass ) { return Queries[frame * Passes.size() + pass]; }
+
+private:
+	std::vector<Pass> Passes;
+	std::vector<Query> Queries;	// latency x passes
+	int Latency;
+	int Frame;
+	int Active;	// pass being timed, or -1 if its query was skipped
+	bool Supported;
+};
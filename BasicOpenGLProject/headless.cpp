@@ -0,0 +1,197 @@
+#include "headless.h"
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#ifndef _WIN32
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+/*=================================================================================================
+  CONSTRUCTORS
+=================================================================================================*/
+
+HeadlessContext::HeadlessContext()
+{
+	Display = nullptr;
+	Context = nullptr;
+	FBO = 0;
+	ColorRBO = 0;
+	DepthRBO = 0;
+	Width = 0;
+	Height = 0;
+}
+
+/*=================================================================================================
+  CREATE
+=================================================================================================*/
+
+bool HeadlessContext::Create( int width, int height )
+{
+	if( !CreateContext() )
+		return false;
+
+	// GLEW's glewInit also loads the window-system extensions, which needs a GLX/WGL context
+	GLenum ret = glewContextInit();
+	if( ret != GLEW_OK )
+	{
+		std::cerr << "GLEW initialization error: " << glewGetErrorString( ret ) << std::endl;
+		return false;
+	}
+
+	Width = width;
+	Height = height;
+
+	glGenRenderbuffers( 1, &ColorRBO );
+	glBindRenderbuffer( GL_RENDERBUFFER, ColorRBO );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, width, height );
+
+	glGenRenderbuffers( 1, &DepthRBO );
+	glBindRenderbuffer( GL_RENDERBUFFER, DepthRBO );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height );
+
+	glGenFramebuffers( 1, &FBO );
+	glBindFramebuffer( GL_FRAMEBUFFER, FBO );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, ColorRBO );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, DepthRBO );
+
+	if( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+	{
+		std::cerr << "Headless framebuffer is incomplete." << std::endl;
+		return false;
+	}
+
+	glViewport( 0, 0, width, height );
+
+	std::cout << "Headless context: " << glGetString( GL_RENDERER ) << ", " << glGetString( GL_VERSION ) << std::endl;
+
+	return true;
+}
+
+#ifdef _WIN32
+
+bool HeadlessContext::CreateContext( void )
+{
+	std::cerr << "Headless mode needs EGL and is only available on Linux." << std::endl;
+	return false;
+}
+
+#else
+
+bool HeadlessContext::CreateContext( void )
+{
+	EGLDisplay display = EGL_NO_DISPLAY;
+
+	// Prefer the surfaceless platform, which needs neither a display server nor a GPU
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+	if( getPlatformDisplay != NULL )
+		display = getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL );
+	if( display == EGL_NO_DISPLAY )
+		display = eglGetDisplay( EGL_DEFAULT_DISPLAY );
+
+	EGLint major, minor;
+	if( display == EGL_NO_DISPLAY || !eglInitialize( display, &major, &minor ) )
+	{
+		std::cerr << "EGL initialization error." << std::endl;
+		return false;
+	}
+	Display = display;
+
+	if( !eglBindAPI( EGL_OPENGL_API ) )
+	{
+		std::cerr << "EGL does not support desktop OpenGL." << std::endl;
+		return false;
+	}
+
+	const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if( !eglChooseConfig( display, configAttributes, &config, 1, &numConfigs ) || numConfigs == 0 )
+	{
+		std::cerr << "No EGL config supports desktop OpenGL." << std::endl;
+		return false;
+	}
+
+	// Match the compatibility context GLUT creates; fall back to core where compatibility 4.0 is missing
+	const EGLint profiles[] = { EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT };
+	EGLContext context = EGL_NO_CONTEXT;
+	for( int i = 0; i < 2 && context == EGL_NO_CONTEXT; i++ )
+	{
+		const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 4,
+			EGL_CONTEXT_MINOR_VERSION, 0,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, profiles[i],
+			EGL_NONE
+		};
+		context = eglCreateContext( display, config, EGL_NO_CONTEXT, contextAttributes );
+	}
+
+	if( context == EGL_NO_CONTEXT )
+	{
+		std::cerr << "Could not create an OpenGL 4.0 context with EGL." << std::endl;
+		return false;
+	}
+	Context = context;
+
+	if( !eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, context ) )
+	{
+		std::cerr << "EGL driver does not support surfaceless contexts." << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+#endif
+
+/*=================================================================================================
+  DESTROY
+=================================================================================================*/
+
+void HeadlessContext::Destroy( void )
+{
+	if( Context == nullptr )
+		return;
+
+	glDeleteFramebuffers( 1, &FBO );
+	glDeleteRenderbuffers( 1, &ColorRBO );
+	glDeleteRenderbuffers( 1, &DepthRBO );
+	FBO = ColorRBO = DepthRBO = 0;
+
+#ifndef _WIN32
+	eglMakeCurrent( (EGLDisplay)Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+	eglDestroyContext( (EGLDisplay)Display, (EGLContext)Context );
+	eglTerminate( (EGLDisplay)Display );
+#endif
+
+	Context = nullptr;
+	Display = nullptr;
+}
+
+/*=================================================================================================
+  SAVE FRAME
+=================================================================================================*/
+
+bool HeadlessContext::SaveFrame( const std::string& path ) const
+{
+	std::vector<unsigned char> pixels( Width * Height * 3 );
+
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, FBO );
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+	glReadPixels( 0, 0, Width, Height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data() );
+
+	std::ofstream file( path, std::ios::binary );
+	if( !file )
+	{
+		std::cerr << "Could not write frame: " << path << std::endl;
+		return false;
+	}
+
+	// PPM rows run top to bottom, GL rows bottom to top
+	file << "P6\n" << Width << " " << Height << "\n255\n";
+	for( int y = Height - 1; y >= 0; y-- )
+		file.write( (const char*)&pixels[y * Width * 3], Width * 3 );
+
+	return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <string>
+
+class HeadlessContext
+{
+public:
+	HeadlessContext();
+
+public:
+	/**
+	Creates a windowless OpenGL context (EGL, surfaceless platform), initializes GLEW for it and
+	binds a width x height framebuffer object that every later draw renders into.
+	*@param width Framebuffer width.
+	*@param height Framebuffer height.
+	*@return True if the context and framebuffer are ready.
+	**/
+	bool Create( int width, int height );
+
+	void Destroy();
+
+	/**
+	Reads back the framebuffer and writes it as a binary PPM image.
+	*@param path Output file path.
+	*@return True if the file was written.
+	**/
+	bool SaveFrame( const std::string& path ) const;
+
+public:
+	int GetWidth()  const { return Width;  }
+	int GetHeight() const { return Height; }
+
+private:
+	bool CreateContext();
+
+private:
+	void* Display;
+	void* Context;
+
+	GLuint FBO;
+	GLuint ColorRBO;
+	GLuint DepthRBO;
+	int Width;
+	int Height;
+};
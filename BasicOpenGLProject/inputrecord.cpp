@@ -0,0 +1,249 @@
+#include "inputrecord.h"
+#include <cstring>
+#include <iostream>
+
+// File layout: "IREC", version, simulation step, then records of
+// { uint32 step, uint8 type, payload } in native byte order
+static const char Magic[4] = { 'I', 'R', 'E', 'C' };
+static const unsigned int Version = 1;
+
+template<typename T>
+static void Write( std::ofstream& file, const T& value )
+{
+	file.write( (const char*)&value, sizeof( T ) );
+}
+
+template<typename T>
+static bool Read( std::ifstream& file, T& value )
+{
+	return (bool)file.read( (char*)&value, sizeof( T ) );
+}
+
+/*=================================================================================================
+  TRAJECTORY HASH
+=================================================================================================*/
+
+void TrajectoryHash::Add( const glm::vec3& position )
+{
+	const unsigned char* bytes = (const unsigned char*)&position[0];
+	for( size_t i = 0; i < sizeof( float ) * 3; i++ )
+	{
+		value ^= bytes[i];
+		value *= 1099511628211ULL;
+	}
+
+	steps++;
+	last = position;
+}
+
+/*=================================================================================================
+  RECORDER
+=================================================================================================*/
+
+InputRecorder::InputRecorder()
+{
+	HasGamepad = false;
+}
+
+InputRecorder::~InputRecorder()
+{
+	// Runs on exit(), so quitting with escape still leaves a complete recording
+	Close();
+}
+
+bool InputRecorder::Open( const std::string& path, double simulationStep )
+{
+	File.open( path, std::ios::binary | std::ios::trunc );
+	if( !File )
+	{
+		std::cerr << "Could not create input recording: " << path << std::endl;
+		return false;
+	}
+
+	File.write( Magic, sizeof( Magic ) );
+	Write( File, Version );
+	Write( File, simulationStep );
+
+	HasGamepad = false;
+	Trajectory = TrajectoryHash();
+
+	return true;
+}
+
+void InputRecorder::RecordStep( unsigned int step, const std::vector<InputEvent>& keys, const GamepadSnapshot& gamepad )
+{
+	if( !File.is_open() )
+		return;
+
+	for( const InputEvent& key : keys )
+	{
+		Write( File, step );
+		Write( File, key.type );
+		if( key.type == INPUT_KEY )
+			Write( File, (unsigned char)key.key );
+		else
+			Write( File, (int)key.key );
+	}
+
+	if( HasGamepad && gamepad.connected == LastGamepad.connected
+		&& memcmp( gamepad.axes, LastGamepad.axes, sizeof( gamepad.axes ) ) == 0
+		&& memcmp( gamepad.buttons, LastGamepad.buttons, sizeof( gamepad.buttons ) ) == 0 )
+		return;
+
+	Write( File, step );
+	Write( File, (unsigned char)INPUT_GAMEPAD );
+	Write( File, (unsigned char)gamepad.connected );
+	File.write( (const char*)gamepad.axes, sizeof( gamepad.axes ) );
+	File.write( (const char*)gamepad.buttons, sizeof( gamepad.buttons ) );
+
+	LastGamepad = gamepad;
+	HasGamepad = true;
+}
+
+void InputRecorder::Close( void )
+{
+	if( !File.is_open() )
+		return;
+
+	Write( File, Trajectory.steps );
+	Write( File, (unsigned char)INPUT_END );
+	Write( File, Trajectory.value );
+	File.write( (const char*)&Trajectory.last[0], sizeof( float ) * 3 );
+	File.close();
+
+	std::cout << "Input recording: " << Trajectory.steps << " steps" << std::endl;
+}
+
+/*=================================================================================================
+  REPLAY
+=================================================================================================*/
+
+InputReplay::InputReplay()
+{
+	NextRecord = 0;
+	Loaded = false;
+	FinalStep = 0;
+}
+
+bool InputReplay::Open( const std::string& path, double simulationStep )
+{
+	std::ifstream file( path, std::ios::binary );
+	if( !file )
+	{
+		std::cerr << "Could not open input recording: " << path << std::endl;
+		return false;
+	}
+
+	char magic[4];
+	unsigned int version;
+	double step;
+	if( !file.read( magic, sizeof( magic ) ) || memcmp( magic, Magic, sizeof( Magic ) ) != 0 || !Read( file, version ) || version != Version || !Read( file, step ) )
+	{
+		std::cerr << "Not an input recording: " << path << std::endl;
+		return false;
+	}
+	if( step != simulationStep )
+	{
+		std::cerr << "Input recording was made with a " << step << " s simulation step, this build uses " << simulationStep << " s" << std::endl;
+		return false;
+	}
+
+	Records.clear();
+	GamepadSnapshot gamepad;
+	bool ended = false;
+
+	Record record;
+	while( !ended && Read( file, record.step ) && Read( file, record.event.type ) )
+	{
+		bool ok = true;
+		switch( record.event.type )
+		{
+			case INPUT_KEY:
+			{
+				unsigned char key;
+				ok = Read( file, key );
+				record.event.key = key;
+				break;
+			}
+
+			case INPUT_SPECIAL_KEY:
+				ok = Read( file, record.event.key );
+				break;
+
+			case INPUT_GAMEPAD:
+			{
+				unsigned char connected;
+				ok = Read( file, connected ) && file.read( (char*)gamepad.axes, sizeof( gamepad.axes ) ) && file.read( (char*)gamepad.buttons, sizeof( gamepad.buttons ) );
+				gamepad.connected = connected != 0;
+				break;
+			}
+
+			case INPUT_END:
+				ok = Read( file, Expected.value ) && file.read( (char*)&Expected.last[0], sizeof( float ) * 3 );
+				Expected.steps = record.step;
+				ended = true;
+				break;
+
+			default:
+				ok = false;
+				break;
+		}
+
+		if( !ok )
+			break;
+
+		record.gamepad = gamepad;
+		if( record.event.type != INPUT_END )
+			Records.push_back( record );
+	}
+
+	if( !ended )
+	{
+		std::cerr << "Input recording is truncated: " << path << std::endl;
+		return false;
+	}
+
+	FinalStep = Expected.steps;
+	NextRecord = 0;
+	Gamepad = GamepadSnapshot();
+	Trajectory = TrajectoryHash();
+	Loaded = true;
+
+	std::cout << "Input replay: " << Records.size() << " events over " << FinalStep << " steps" << std::endl;
+
+	return true;
+}
+
+const std::vector<InputEvent>& InputReplay::BeginStep( unsigned int step )
+{
+	StepKeys.clear();
+
+	while( NextRecord < Records.size() && Records[NextRecord].step <= step )
+	{
+		const Record& record = Records[NextRecord++];
+		if( record.event.type == INPUT_GAMEPAD )
+			Gamepad = record.gamepad;
+		else
+			StepKeys.push_back( record.event );
+	}
+
+	return StepKeys;
+}
+
+void InputReplay::Close( void )
+{
+	Records.clear();
+	StepKeys.clear();
+	NextRecord = 0;
+	Loaded = false;
+}
+
+bool InputReplay::Verify( std::ostream& out ) const
+{
+	bool match = Trajectory.steps == Expected.steps && Trajectory.value == Expected.value;
+
+	out << "Input replay " << ( match ? "reproduced" : "DIVERGED from" ) << " the recorded trajectory (" << Trajectory.steps << " steps, final position "
+		<< Trajectory.last.x << ", " << Trajectory.last.y << ", " << Trajectory.last.z << ")" << std::endl;
+
+	return match;
+}
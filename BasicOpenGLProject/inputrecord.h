@@ -0,0 +1,141 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <ostream>
+
+// Gamepad state as consumed by one simulation step
+struct GamepadSnapshot
+{
+	static const int MaxAxes = 6;
+	static const int MaxButtons = 16;
+
+	bool connected = false;
+	float axes[MaxAxes] = {};
+	unsigned char buttons[MaxButtons] = {};
+};
+
+enum InputEventType
+{
+	INPUT_KEY = 1,			// keyboard_func key
+	INPUT_SPECIAL_KEY = 2,	// key_special_pressed key
+	INPUT_GAMEPAD = 3,		// gamepad state changed
+	INPUT_END = 4			// end of the recording, with the trajectory it produced
+};
+
+struct InputEvent
+{
+	unsigned char type;
+	int key;
+};
+
+// FNV-1a over the bit patterns of the player position after every step
+struct TrajectoryHash
+{
+	unsigned long long value = 14695981039346656037ULL;
+	unsigned int steps = 0;
+	glm::vec3 last = glm::vec3( 0.0f );
+
+	void Add( const glm::vec3& position );
+};
+
+class InputRecorder
+{
+public:
+	InputRecorder();
+	~InputRecorder();
+
+public:
+	/**
+	Starts writing a recording.
+	*@param path Output file.
+	*@param simulationStep Length of a simulation step; replays refuse files made with another step.
+	*@return True if the file could be created.
+	**/
+	bool Open( const std::string& path, double simulationStep );
+
+	/**
+	Writes the input one simulation step consumed. The gamepad is only stored when it changed.
+	*@param step Index of the simulation step.
+	*@param keys Keyboard events applied before the step, in order.
+	*@param gamepad Gamepad state the step read.
+	**/
+	void RecordStep( unsigned int step, const std::vector<InputEvent>& keys, const GamepadSnapshot& gamepad );
+
+	// Adds the player position the step produced to the trajectory hash
+	void EndStep( const glm::vec3& position ) { Trajectory.Add( position ); }
+
+	// Writes the end marker and closes the file; also done on destruction
+	void Close();
+
+	bool IsRecording() const { return File.is_open(); }
+
+private:
+	std::ofstream File;
+	GamepadSnapshot LastGamepad;
+	bool HasGamepad;
+	TrajectoryHash Trajectory;
+};
+
+class InputReplay
+{
+public:
+	InputReplay();
+
+public:
+	/**
+	Loads a recording made by InputRecorder.
+	*@param path Recording file.
+	*@param simulationStep Length of a simulation step; must match the recording.
+	*@return True if the file was read.
+	**/
+	bool Open( const std::string& path, double simulationStep );
+
+	/**
+	Returns the keyboard events recorded for a step and brings GetGamepad() up to date with it.
+	Steps must be requested in increasing order.
+	*@param step Index of the simulation step.
+	**/
+	const std::vector<InputEvent>& BeginStep( unsigned int step );
+
+	// Adds the player position the step produced to the trajectory hash
+	void EndStep( const glm::vec3& position ) { Trajectory.Add( position ); }
+
+	// True once every recorded step has been replayed
+	bool IsFinished( unsigned int step ) const { return step >= FinalStep; }
+
+	bool IsReplaying() const { return Loaded; }
+
+	// Drops the loaded recording; IsReplaying() is false afterwards
+	void Close();
+
+	/**
+	Compares the trajectory so far with the one stored in the recording.
+	*@param out Stream the result is printed to.
+	*@return True if they are identical.
+	**/
+	bool Verify( std::ostream& out ) const;
+
+	const GamepadSnapshot& GetGamepad() const { return Gamepad; }
+
+private:
+	struct Record
+	{
+		unsigned int step;
+		InputEvent event;
+		GamepadSnapshot gamepad;
+	};
+
+private:
+	std::vector<Record> Records;
+	size_t NextRecord;
+	std::vector<InputEvent> StepKeys;
+	GamepadSnapshot Gamepad;
+	bool Loaded;
+
+	unsigned int FinalStep;
+	TrajectoryHash Expected;
+	TrajectoryHash Trajectory;
+};
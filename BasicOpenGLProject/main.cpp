@@ -1,6 +1,7 @@
 #define _USE_MATH_DEFINES
 #define STB_IMAGE_IMPLEMENTATION
 #define MAX_BONE_INFLUENCE 4
+#define MAX_BONES 100
 
 #include <GL/glew.h>
 #include <GL/freeglut.h>
@@ -13,11 +14,32 @@
 #include <assimp/postprocess.h>
 
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <cmath>
 #include <iostream>
 #include <unordered_map>
+#include <map>
+#include <random>
 #include "shader.h"
 #include "shaderprogram.h"
+#include "texturemanager.h"
+#include "framepacer.h"
+#include "headless.h"
+#include "inputrecord.h"
+#include "profiler.h"
+#include "gputimer.h"
+#include "mappedfile.h"
+#include "mappedio.h"
+#include "cookedfile.h"
+#include "vertexformat.h"
+#include "shaderpermutations.h"
+#include "textureloader.h"
+#include "materialarray.h"
+#include "assetarchive.h"
+#include "assetcooker.h"
 #include "stb_image.h"
 
 /*=================================================================================================
@@ -79,11 +101,66 @@ glm::vec3 direction_vector1(0.0, 0.0, 0.0);
 glm::vec3 direction_vector2(0.0, 0.0, 0.0);
 glm::vec3 respawn_point(0.0, 0.0, 0.0);
 
+//Fixed-rate simulation. Physics always advances in SimulationStep increments, whatever the frame rate;
+//the step matches the 5.5 ms frame cap the movement and jump constants were tuned at.
+const double SimulationStep = 1.0 / 180.0;
+const int MaxStepsPerFrame = 10;
+double simulationTime = 0.0;
+double simulationAccumulator = 0.0;
+double lastSimulationUpdate = 0.0;
+glm::vec3 previous_player_pos(0.0, 0.0, 0.0);
+glm::vec3 render_player_pos(0.0, 0.0, 0.0);
+
+//Frame pacing
+FramePacer framePacer;
+PacingMode pacingMode = PACE_LIMITED;
+double targetFrameRate = 60.0;
+
+//GPU time per render pass
+enum RenderPass { PASS_TILES, PASS_PLAYER, PASS_SKYBOX };
+GpuTimer gpuTimer;
+
+//Headless rendering (no window; frames go to an offscreen framebuffer)
+HeadlessContext headlessContext;
+bool headless = false;
+int headlessFrames = 600;
+std::string headlessDumpDir;
+double virtualClock = 0.0;
+
+//Input recording and replay. Gameplay input is applied at simulation steps, so a recording keyed by
+//step index reproduces the same trajectory
+InputRecorder inputRecorder;
+InputReplay inputReplay;
+std::string recordPath;
+std::string replayPath;
+bool replayFast = false;
+unsigned int simulationSteps = 0;
+std::vector<InputEvent> pendingKeys;
+GamepadSnapshot stepGamepad;
+
 //Animation
-float lastFrame = 0.0f;
 float lastFrameAnim = 0.0f;
 float deltaTime = 0.0f;
 int animationNum = 6;
+int animationSwitchCount = 0;
+double animationSwitchTotal = 0.0;
+double animationSwitchMax = 0.0;
+bool compactBonePalette = false;
+bool benchmarkSkeleton = false;
+bool instancedTiles = false;
+bool benchmarkCollision = false;
+bool benchmarkModelLoad = false;
+bool useModelCache = true;
+bool packedVertices = true;
+bool useShaderCache = true;
+//Cooked shaders, textures and models, written by --cook-assets; sources missing from it, or edited since, load from disk
+AssetArchive assets;
+const char* assetArchivePath = "assets.pak";
+bool useAssetArchive = true;
+bool cookAssets = false;
+size_t vertexBufferBytes = 0;
+size_t unpackedVertexBytes = 0;
+std::vector<glm::vec4> compactBoneMatrices;
 
 bool gameFinish = false;
 float startTime = 0;
@@ -95,7 +172,11 @@ int livesCount = 3;
 
 ShaderProgram PassthroughShader;
 ShaderProgram SkyboxShader;
-ShaderProgram PerspectiveShader;
+//Feature bits of the perspective shader variants
+enum ShaderFeature { SHADER_SKINNED = 1 << 0, SHADER_LIT = 1 << 1, SHADER_TEXTURE_ARRAY = 1 << 2 };
+ShaderPermutations PerspectiveShaders;
+ShaderPermutations InstancedTileShaders;
+unsigned int shadingFeatures = SHADER_LIT;
 
 glm::mat4 PerspProjectionMatrix( 1.0f );
 glm::mat4 PerspViewMatrix( 1.0f );
@@ -105,15 +186,28 @@ glm::mat4 SkyboxViewMatrix(1.0f);
 float perspZoom = 1.0f, perspSensitivity = 0.35f;
 float perspRotationX = 0.0f, perspRotationY = 0.0f;
 
+/*=================================================================================================
+	TEXTURES
+=================================================================================================*/
+
+TextureManager Textures;
+TextureLoader textureLoader;
+bool asyncTextures = true;
+size_t textureUploadBudget = 1024 * 1024;	//pixel bytes uploaded per frame
+
+//Every floor material in one texture array; tiles pick their layer
+enum FloorMaterial { MATERIAL_WOOD, MATERIAL_CHECKPOINT, MATERIAL_FINISH, MATERIAL_FRAGILE, MATERIAL_ROAD };
+const char* floorMaterialPaths[] = { "textures/wood_3.png", "textures/casset_block_1.png", "textures/special_floor_1.png",
+	"textures/wood_fragile.png", "textures/road1.png" };
+MaterialArray floorMaterials;
+bool textureArrayTiles = true;
+
 /*=================================================================================================
 	FUNCTIONS
 =================================================================================================*/
 
 GLuint loadSkybox(std::vector<const char*> faces);
 GLuint TextureFromFile();
-GLuint FloorTexture1();
-GLuint FloorTexture2();
-GLuint FloorTexture3();
 
 /*=================================================================================================
 	CLASSES
@@ -169,6 +263,7 @@ class Mesh {
 		std::vector<GLuint>  indices;
 		std::vector<Texture> textures;
 		GLuint VAO;
+		GLsizei indexCount;
 
 		Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures)
 		{
@@ -176,7 +271,22 @@ class Mesh {
 			this->indices = indices;
 			this->textures = textures;
 
-			setupMesh();
+			setupMesh(vertices.data(), (GLsizei)vertices.size(), indices.data(), (GLsizei)indices.size());
+		}
+		//Uploads vertex and index data straight from memory the mesh does not keep (a mapped cooked model)
+		Mesh(const Vertex* vertexData, GLsizei vertexCount, const GLuint* indexData, GLsizei indexCount, std::vector<Texture> textures)
+		{
+			this->textures = textures;
+
+			setupMesh(vertexData, vertexCount, indexData, indexCount);
+		}
+		//Keeps the data on the CPU without creating buffers, for cooking without a GL context
+		Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices)
+		{
+			this->vertices = vertices;
+			this->indices = indices;
+			this->indexCount = (GLsizei)indices.size();
+			VAO = VBO = EBO = 0;
 		}
 		void Draw()
 		{
@@ -184,24 +294,45 @@ class Mesh {
 			glBindTexture(GL_TEXTURE_2D, textures[0].id);
 
 			glBindVertexArray(VAO);
-			glDrawElements(GL_TRIANGLES, static_cast<GLuint>(indices.size()), GL_UNSIGNED_INT, 0);
+			glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
 			glBindVertexArray(0);
 			glActiveTexture(GL_TEXTURE0);
 		}
+		void Delete()
+		{
+			if (VAO == 0)
+				return;
+			glDeleteVertexArrays(1, &VAO);
+			glDeleteBuffers(1, &VBO);
+			glDeleteBuffers(1, &EBO);
+			VAO = VBO = EBO = 0;
+		}
 	private:
 		GLuint VBO, EBO;
-		void setupMesh()
+		void setupMesh(const Vertex* vertexData, GLsizei vertexCount, const GLuint* indexData, GLsizei indexCount)
 		{
+			this->indexCount = indexCount;
+
 			glGenVertexArrays(1, &VAO);
 			glGenBuffers(1, &VBO);
 			glGenBuffers(1, &EBO);
 
 			glBindVertexArray(VAO);
 			glBindBuffer(GL_ARRAY_BUFFER, VBO);
-			glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
 
 			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLuint), indexData, GL_STATIC_DRAW);
+
+			unpackedVertexBytes += vertexCount * sizeof(Vertex);
+			if (packedVertices)
+			{
+				uploadPacked(vertexData, vertexCount);
+				glBindVertexArray(0);
+				return;
+			}
+
+			glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertexData, GL_STATIC_DRAW);
+			vertexBufferBytes += vertexCount * sizeof(Vertex);
 
 			glEnableVertexAttribArray(0);
 			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
@@ -210,20 +341,161 @@ class Mesh {
 			glEnableVertexAttribArray(2);
 			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
 			glEnableVertexAttribArray(3);
-			glVertexAttribIPointer(3, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
+			//The shader reads unsigned ids; the -1 of unused slots arrives as a huge id with zero weight
+			glVertexAttribIPointer(3, 4, GL_UNSIGNED_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
 			glEnableVertexAttribArray(4);
 			glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
 
 			glBindVertexArray(0);
 		}
+		//Picks the skinned layout only if some vertex is weighted to a bone, and half positions only if the mesh is small enough around its origin
+		void uploadPacked(const Vertex* vertexData, GLsizei vertexCount)
+		{
+			bool skinned = false;
+			glm::vec3 lo(0.0f), hi(0.0f);
+			for (GLsizei i = 0; i < vertexCount; i++)
+			{
+				const Vertex& v = vertexData[i];
+				for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+					skinned |= v.m_BoneIDs[j] >= 0 && v.m_Weights[j] > 0.0f;
+				lo = i == 0 ? v.Position : glm::min(lo, v.Position);
+				hi = i == 0 ? v.Position : glm::max(hi, v.Position);
+			}
+
+			VertexFormat format(skinned, VertexFormat::HalfPositionsFit(lo, hi), true);
+			std::vector<unsigned char> packed(format.GetStride() * vertexCount);
+			for (GLsizei i = 0; i < vertexCount; i++)
+			{
+				const Vertex& v = vertexData[i];
+				format.Pack(&packed[i * format.GetStride()], v.Position, v.Normal, v.TexCoords, v.m_BoneIDs, v.m_Weights);
+			}
+
+			glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.empty() ? NULL : packed.data(), GL_STATIC_DRAW);
+			format.SetAttributes();
+			vertexBufferBytes += packed.size();
+		}
+};
+
+//An image embedded in a model file, laid out like aiTexture: encoded (PNG, JPEG, ...) when height is 0,
+//with width holding the byte count, otherwise width * height BGRA texels
+struct EmbeddedImage {
+	const unsigned char* data;
+	unsigned int width;
+	unsigned int height;
+
+	size_t GetSize() const { return height == 0 ? width : (size_t)width * height * 4; }
 };
 
 class Model {
 	public:
 		Model(std::string path)
 		{
+			name = path;
 			loadModel(path);
 		}
+		//name keys the embedded textures, so models loaded from the same file share them.
+		//A cpuOnly model keeps what Cook writes and creates no buffers or textures, so it needs no GL context.
+		Model(const aiScene* scene, const std::string& name, bool cpuOnly = false)
+		{
+			PROFILE_ZONE("Model::Model");
+			this->name = name;
+			this->cpuOnly = cpuOnly;
+			processNode(scene->mRootNode, scene);
+		}
+		//Reads the images, meshes and bone table written by Cook; vertex and index blobs go to the GPU in place
+		Model(CookedReader& reader, const std::string& name)
+		{
+			PROFILE_ZONE("Model::Model");
+			this->name = name;
+
+			unsigned int imageCount = 0;
+			reader.Read(imageCount);
+			std::vector<EmbeddedImage> images;
+			for (unsigned int i = 0; i < imageCount && reader.IsValid(); i++)
+			{
+				EmbeddedImage image = {};
+				reader.Read(image.width);
+				reader.Read(image.height);
+				image.data = reader.ReadArray<unsigned char>(image.GetSize());
+				if (image.data == nullptr)
+					break;
+				images.push_back(image);
+			}
+
+			unsigned int meshCount = 0;
+			reader.Read(meshCount);
+			for (unsigned int i = 0; i < meshCount && reader.IsValid(); i++)
+			{
+				int image = -1;
+				unsigned int vertexCount = 0, indexCount = 0;
+				reader.Read(image);
+				reader.Read(vertexCount);
+				reader.Read(indexCount);
+				const Vertex* vertices = reader.ReadArray<Vertex>(vertexCount);
+				const GLuint* indices = reader.ReadArray<GLuint>(indexCount);
+				if (vertices == nullptr || indices == nullptr)
+					break;
+
+				Texture tex;
+				tex.id = image >= 0 && image < (int)images.size() ? AcquireEmbeddedTexture(image, images[image]) : TextureFromFile();
+				tex.type = "texture_diffuse";
+				meshes.push_back(Mesh(vertices, vertexCount, indices, indexCount, std::vector<Texture>(1, tex)));
+				meshImages.push_back(image);
+			}
+
+			unsigned int boneCount = 0;
+			reader.Read(m_BoneCounter);
+			reader.Read(boneCount);
+			for (unsigned int i = 0; i < boneCount && reader.IsValid(); i++)
+			{
+				std::string name;
+				BoneInfo info;
+				reader.ReadString(name);
+				reader.Read(info.id);
+				reader.Read(info.offset);
+				m_BoneInfoMap[name] = info;
+			}
+		}
+		~Model()
+		{
+			for (GLuint i = 0; i < meshes.size(); i++)
+			{
+				for (GLuint j = 0; j < meshes[i].textures.size(); j++)
+					Textures.Release(meshes[i].textures[j].id);
+				meshes[i].Delete();
+			}
+		}
+		//Writes the scene's embedded images, then the meshes in their GPU vertex layout, followed by the bone table
+		void Cook(CookedWriter& writer, const aiScene* scene)
+		{
+			writer.Write(scene->mNumTextures);
+			for (GLuint i = 0; i < scene->mNumTextures; i++)
+			{
+				EmbeddedImage image = GetEmbeddedImage(scene->mTextures[i]);
+				writer.Write(image.width);
+				writer.Write(image.height);
+				writer.WriteArray(image.data, image.GetSize());
+			}
+
+			writer.Write((unsigned int)meshes.size());
+			for (GLuint i = 0; i < meshes.size(); i++)
+			{
+				writer.Write(meshImages[i]);
+				writer.Write((unsigned int)meshes[i].vertices.size());
+				writer.Write((unsigned int)meshes[i].indices.size());
+				writer.WriteArray(meshes[i].vertices.data(), meshes[i].vertices.size());
+				writer.WriteArray(meshes[i].indices.data(), meshes[i].indices.size());
+			}
+
+			writer.Write(m_BoneCounter);
+			writer.Write((unsigned int)m_BoneInfoMap.size());
+			for (auto& bone : m_BoneInfoMap)
+			{
+				writer.WriteString(bone.first);
+				writer.Write(bone.second.id);
+				writer.Write(bone.second.offset);
+			}
+		}
 		void Draw()
 		{
 			for (GLuint i = 0; i < meshes.size(); i++)
@@ -232,14 +504,50 @@ class Model {
 		auto& GetBoneInfoMap() { return m_BoneInfoMap; }
 		int& GetBoneCount() { return m_BoneCounter; }
 	private:
+		std::string name;
 		std::vector<Mesh> meshes;
+		std::vector<int> meshImages;	//embedded image of each mesh, -1 for none
 		std::unordered_map<std::string, BoneInfo> m_BoneInfoMap;
 		int m_BoneCounter = 0;
+		bool cpuOnly = false;
+
+		static EmbeddedImage GetEmbeddedImage(const aiTexture* texture)
+		{
+			EmbeddedImage image;
+			image.data = reinterpret_cast<const unsigned char*>(texture->pcData);
+			image.width = texture->mWidth;
+			image.height = texture->mHeight;
+			return image;
+		}
+		//Embedded images are referenced as "*<index>"; some importers use the original file name instead
+		static int FindEmbeddedImage(const aiScene* scene, const aiString& path)
+		{
+			if (path.length > 1 && path.data[0] == '*')
+			{
+				int index = atoi(path.C_Str() + 1);
+				return index < (int)scene->mNumTextures ? index : -1;
+			}
+			for (GLuint i = 0; i < scene->mNumTextures; i++)
+			{
+				if (path.length > 0 && scene->mTextures[i]->mFilename == path)
+					return i;
+			}
+			return -1;
+		}
+		//Decodes an image the first time any mesh of a model from this file asks for it, without touching the disk.
+		//Assimp flips V on import, so the rows are flipped to match; textures/player.png was saved pre-flipped instead.
+		GLuint AcquireEmbeddedTexture(int index, const EmbeddedImage& image)
+		{
+			std::string key = name + "*" + std::to_string(index);
+			if (image.height == 0)
+				return Textures.AcquireEncoded(key, image.data, image.GetSize(), true);
+			return Textures.AcquirePixels(key, image.data, image.width, image.height, GL_BGRA, true);
+		}
 
 		void loadModel(std::string path)
 		{
 			Assimp::Importer importer;
-			const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate);
+			const aiScene* scene = MappedIOSystem::ReadFile(importer, path, aiProcess_Triangulate);
 			if (!scene)
 			{
 				std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
@@ -305,17 +613,24 @@ class Model {
 				for (GLuint j = 0; j < face.mNumIndices; j++)
 					indices.push_back(face.mIndices[j]);
 			}
+			//Meshes without an embedded diffuse image fall back to the texture on disk
 			aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
 			aiString str;
-			material->Get(AI_MATKEY_TEXTURE(aiTextureType_DIFFUSE, 0), str);
-			aiTexture *texture = scene->mTextures[atoi(str.C_Str())];
+			int image = -1;
+			if (material->Get(AI_MATKEY_TEXTURE(aiTextureType_DIFFUSE, 0), str) == AI_SUCCESS)
+				image = FindEmbeddedImage(scene, str);
+			meshImages.push_back(image);
+
+			ExtractBoneWeightForVertices(vertices, mesh, scene);
+
+			if (cpuOnly)
+				return Mesh(vertices, indices);
+
 			Texture tex;
-			tex.id = TextureFromFile();
+			tex.id = image >= 0 ? AcquireEmbeddedTexture(image, GetEmbeddedImage(scene->mTextures[image])) : TextureFromFile();
 			tex.type = "texture_diffuse";
 			textures.push_back(tex);
 
-			ExtractBoneWeightForVertices(vertices, mesh, scene);
-
 			Mesh temp(vertices, indices, textures);
 			return temp;
 		}
@@ -389,24 +704,18 @@ class Model {
 
 GLuint TextureFromFile()
 {
-	GLuint textureID;
-	glGenTextures(1, &textureID);
-	int width, height, nrChannels;
-	unsigned char* data = stbi_load("textures/player.png", &width, &height, &nrChannels, 0);
-	if (data)
-	{
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+	return Textures.Acquire("textures/player.png");
+}
 
-		stbi_image_free(data);
-	}
+struct TileBounds {
+	glm::vec3 min;
+	glm::vec3 max;
+};
 
-	return textureID;
+//The player stands on a tile when it is strictly inside the tile's XZ footprint and within its height
+inline bool PointOnTile(const glm::vec3& p, const TileBounds& b)
+{
+	return p.x > b.min.x && p.x < b.max.x && p.z > b.min.z && p.z < b.max.z && p.y > b.min.y && p.y <= b.max.y;
 }
 
 class rectangularPrism {
@@ -420,8 +729,10 @@ public:
 	bool isCheckpoint;
 	bool checkpointReached;
 	bool isFinish;
+	FloorMaterial surface;
 
-	rectangularPrism(float x, float y, float z, float length, float width, float height, bool isCheckpoint, bool isFinish) {
+	//surface only applies to plain tiles; checkpoints and the finish have their own materials
+	rectangularPrism(float x, float y, float z, float length, float width, float height, bool isCheckpoint, bool isFinish, FloorMaterial surface = MATERIAL_WOOD) {
 		this->x = x * tileScale - (tileScale / 2);
 		this->y = (y * tileScale) - 0.1;
 		this->z = z * tileScale - (tileScale / 2);
@@ -431,27 +742,32 @@ public:
 		this->isCheckpoint = isCheckpoint;
 		this->checkpointReached = false;
 		this->isFinish = isFinish;
+		this->surface = surface;
 
-		std::vector<Vertex> vertices = calcVertices();
-		std::vector<GLuint>  indices;
-		for (int i = 0; i < 36; i++) {
-			indices.push_back(i);
-		}
-		std::vector<Texture> textures;
-		Texture tex;
-		if (!isCheckpoint && !isFinish)
-			tex.id = FloorTexture1();
-		else if (isCheckpoint && !isFinish)
-			tex.id = FloorTexture2();
-		else if (isFinish)
-			tex.id = FloorTexture3();
-		tex.type = "texture_diffuse";
-		textures.push_back(tex);
-		mesh = new Mesh(vertices, indices, textures);
+		//Tiles drawn from floorMaterials never bind their own texture; see acquireTexture
+		texture.id = 0;
+		texture.type = "texture_diffuse";
+	}
+
+	//Tiles do not own GPU buffers; LevelBatch merges their geometry
+	std::vector<Vertex> GetVertices() {
+		return calcVertices(x, y, z, length, width, height);
+	}
+
+	//Vertices of an axis-aligned box with its minimum corner at (x, y, z)
+	static std::vector<Vertex> BoxVertices(float x, float y, float z, float length, float width, float height) {
+		return calcVertices(x, y, z, length, width, height);
+	}
+
+	GLuint GetTexture() {
+		return texture.id;
 	}
 
-	void Draw() {
-		mesh->Draw();
+	//Layer of the tile's texture in floorMaterials
+	int GetMaterial() {
+		if (isFinish)
+			return MATERIAL_FINISH;
+		return isCheckpoint ? MATERIAL_CHECKPOINT : surface;
 	}
 
 	float minX() {
@@ -508,12 +824,26 @@ public:
 		}
 	}
 
-	void deleteMesh() {
-		delete mesh;
+	TileBounds GetBounds() {
+		TileBounds bounds;
+		bounds.min = glm::vec3(minX(), minY(), minZ());
+		bounds.max = glm::vec3(maxX(), maxY(), maxZ());
+		return bounds;
+	}
+
+	//Loads the tile's own 2D texture, for drawing without the texture array
+	void acquireTexture() {
+		texture.id = Textures.Acquire(floorMaterialPaths[GetMaterial()]);
+	}
+
+	void releaseTexture() {
+		if (texture.id != 0)
+			Textures.Release(texture.id);
+		texture.id = 0;
 	}
 
 private:
-	Mesh* mesh;
+	Texture texture;
 
 	enum Direction {
 		xpos,
@@ -531,10 +861,17 @@ private:
 		br
 	};
 
-	Vertex calcVertex(float xPos, float yPos, float zPos, Direction dir, texPos tex) {
+	static Vertex calcVertex(float xPos, float yPos, float zPos, Direction dir, texPos tex) {
 		Vertex vertex;
 		glm::vec3 vector;
 
+		//Tiles are not skinned
+		for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+		{
+			vertex.m_BoneIDs[i] = -1;
+			vertex.m_Weights[i] = 0.0f;
+		}
+
 		//Position
 		vector.x = xPos;
 		vector.y = yPos;
@@ -602,7 +939,7 @@ private:
 		return vertex;
 	}
 
-	std::vector<Vertex> calcVertices() {
+	static std::vector<Vertex> calcVertices(float x, float y, float z, float length, float width, float height) {
 		std::vector<Vertex>  vertices;
 		for (GLuint i = 0; i < 6; i++) //Different Faces
 		{
@@ -671,69 +1008,335 @@ private:
 	}
 };
 
-GLuint FloorTexture1()
-{
-	GLuint textureID;
-	glGenTextures(1, &textureID);
-	int width, height, nrChannels;
-	unsigned char* data = stbi_load("textures/wood_3.png", &width, &height, &nrChannels, 0);
-	if (data)
+//All level tiles merged into one vertex/index buffer, sorted by texture so each material is a single draw call.
+//With a texture array every vertex carries its layer instead, and the whole level is one draw call.
+class LevelBatch {
+public:
+	void Build(std::vector<rectangularPrism>& tiles, GLuint arrayTexture = 0)
+	{
+		Delete();
+
+		//Group tiles by texture
+		std::map<GLuint, std::vector<int>> tilesByTexture;
+		for (int i = 0; i < tiles.size(); i++)
+			tilesByTexture[tiles[i].GetTexture()].push_back(i);
+
+		std::vector<Vertex> vertices;
+		std::vector<GLuint> indices;
+		std::vector<float> vertexLayers;
+		vertices.reserve(tiles.size() * 36);
+		indices.reserve(tiles.size() * 36);
+
+		for (auto& group : tilesByTexture)
+		{
+			Material material;
+			material.texture = group.first;
+			material.firstIndex = indices.size();
+
+			for (int tile : group.second)
+			{
+				std::vector<Vertex> tileVertices = tiles[tile].GetVertices();
+				GLuint baseVertex = (GLuint)vertices.size();
+				for (GLuint i = 0; i < tileVertices.size(); i++)
+					indices.push_back(baseVertex + i);
+				vertices.insert(vertices.end(), tileVertices.begin(), tileVertices.end());
+				vertexLayers.insert(vertexLayers.end(), tileVertices.size(), (float)tiles[tile].GetMaterial());
+			}
+
+			material.count = (GLsizei)(indices.size() - material.firstIndex);
+			materials.push_back(material);
+		}
+
+		if (vertices.empty())
+			return;
+
+		mesh = new Mesh(vertices, indices, std::vector<Texture>());
+
+		if (arrayTexture != 0)
+		{
+			materials.assign(1, Material{ arrayTexture, 0, (GLsizei)indices.size() });
+			textureTarget = GL_TEXTURE_2D_ARRAY;
+
+			glGenBuffers(1, &layerVBO);
+			glBindVertexArray(mesh->VAO);
+			glBindBuffer(GL_ARRAY_BUFFER, layerVBO);
+			glBufferData(GL_ARRAY_BUFFER, vertexLayers.size() * sizeof(float), vertexLayers.data(), GL_STATIC_DRAW);
+			glEnableVertexAttribArray(5);
+			glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
+			glBindVertexArray(0);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+	}
+
+	void Draw()
 	{
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		if (!mesh)
+			return;
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+		glActiveTexture(GL_TEXTURE0);
+		glBindVertexArray(mesh->VAO);
+		for (int i = 0; i < materials.size(); i++)
+		{
+			glBindTexture(textureTarget, materials[i].texture);
+			glDrawElements(GL_TRIANGLES, materials[i].count, GL_UNSIGNED_INT, (void*)(materials[i].firstIndex * sizeof(GLuint)));
+		}
+		glBindVertexArray(0);
+	}
 
-		stbi_image_free(data);
+	void Delete()
+	{
+		if (mesh)
+			mesh->Delete();
+		delete mesh;
+		mesh = nullptr;
+		materials.clear();
+		glDeleteBuffers(1, &layerVBO);
+		layerVBO = 0;
+		textureTarget = GL_TEXTURE_2D;
 	}
 
-	return textureID;
-}
-GLuint FloorTexture2()
-{
-	GLuint textureID;
-	glGenTextures(1, &textureID);
-	int width, height, nrChannels;
-	unsigned char* data = stbi_load("textures/casset_block_1.png", &width, &height, &nrChannels, 0);
-	if (data)
+	int GetDrawCalls() { return (int)materials.size(); }
+
+private:
+	struct Material {
+		GLuint texture;
+		size_t firstIndex;
+		GLsizei count;
+	};
+
+	Mesh* mesh = nullptr;
+	std::vector<Material> materials;
+	GLuint layerVBO = 0;
+	GLenum textureTarget = GL_TEXTURE_2D;
+};
+
+//Uniform grid over the XZ footprints of the tiles. Each cell lists the tiles overlapping it in tile order,
+//stored as one flat array indexed by cellStart, so a point query reads a single cell.
+class TileGrid {
+public:
+	void Build(const std::vector<TileBounds>& tileBounds, float targetCellSize)
+	{
+		bounds = tileBounds;
+		cellStart.assign(1, 0);
+		cellTiles.clear();
+		columns = rows = 0;
+		if (bounds.empty())
+			return;
+
+		glm::vec3 lo = bounds[0].min;
+		glm::vec3 hi = bounds[0].max;
+		for (int i = 1; i < bounds.size(); i++)
+		{
+			lo = glm::min(lo, bounds[i].min);
+			hi = glm::max(hi, bounds[i].max);
+		}
+
+		//Limit the grid resolution so a few far-away tiles cannot blow up memory
+		const float maxCells = 2048.0f;
+		originX = lo.x;
+		originZ = lo.z;
+		cellSize = std::max(targetCellSize, std::max(hi.x - lo.x, hi.z - lo.z) / maxCells);
+		columns = (int)((hi.x - lo.x) / cellSize) + 1;
+		rows = (int)((hi.z - lo.z) / cellSize) + 1;
+
+		//Count the tiles in each cell, then fill in tile order
+		cellStart.assign(columns * rows + 1, 0);
+		for (int i = 0; i < bounds.size(); i++)
+			ForEachCell(bounds[i], [&](int cell) { cellStart[cell + 1]++; });
+		for (int c = 0; c < columns * rows; c++)
+			cellStart[c + 1] += cellStart[c];
+
+		cellTiles.resize(cellStart.back());
+		std::vector<int> next(cellStart.begin(), cellStart.end() - 1);
+		for (int i = 0; i < bounds.size(); i++)
+			ForEachCell(bounds[i], [&](int cell) { cellTiles[next[cell]++] = i; });
+	}
+
+	//First tile (in tile order) the point is standing on, or -1
+	int FindTile(const glm::vec3& point)
 	{
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		if (columns == 0)
+			return -1;
+
+		int column = (int)std::floor((point.x - originX) / cellSize);
+		int row = (int)std::floor((point.z - originZ) / cellSize);
+		if (column < 0 || column >= columns || row < 0 || row >= rows)
+			return -1;
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+		int cell = row * columns + column;
+		for (int k = cellStart[cell]; k < cellStart[cell + 1]; k++)
+		{
+			if (PointOnTile(point, bounds[cellTiles[k]]))
+				return cellTiles[k];
+		}
+		return -1;
+	}
 
-		stbi_image_free(data);
+	const TileBounds& GetBounds(int tile) { return bounds[tile]; }
+
+private:
+	template<typename Function>
+	void ForEachCell(const TileBounds& b, Function function)
+	{
+		int column0 = std::max(0, (int)std::floor((b.min.x - originX) / cellSize));
+		int column1 = std::min(columns - 1, (int)std::floor((b.max.x - originX) / cellSize));
+		int row0 = std::max(0, (int)std::floor((b.min.z - originZ) / cellSize));
+		int row1 = std::min(rows - 1, (int)std::floor((b.max.z - originZ) / cellSize));
+		for (int row = row0; row <= row1; row++)
+			for (int column = column0; column <= column1; column++)
+				function(row * columns + column);
 	}
 
-	return textureID;
-}
-GLuint FloorTexture3()
-{
-	GLuint textureID;
-	glGenTextures(1, &textureID);
-	int width, height, nrChannels;
-	unsigned char* data = stbi_load("textures/special_floor_1.png", &width, &height, &nrChannels, 0);
-	if (data)
+	std::vector<TileBounds> bounds;
+	std::vector<int> cellStart;
+	std::vector<int> cellTiles;
+	float originX = 0.0f;
+	float originZ = 0.0f;
+	float cellSize = 1.0f;
+	int columns = 0;
+	int rows = 0;
+};
+
+//Draws every tile as an instance of one unit cube. Each instance only stores its box and texture layer,
+//so moving or adding tiles just rewrites the instance buffer.
+class TileInstancer {
+public:
+	void Build(std::vector<rectangularPrism>& tiles, GLuint arrayTexture = 0)
 	{
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		if (!cube)
+		{
+			std::vector<Vertex> vertices = rectangularPrism::BoxVertices(0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f);
+			std::vector<GLuint> indices;
+			for (GLuint i = 0; i < vertices.size(); i++)
+				indices.push_back(i);
+			cube = new Mesh(vertices, indices, std::vector<Texture>());
+
+			glGenBuffers(1, &instanceVBO);
+			glBindVertexArray(cube->VAO);
+			glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+			glEnableVertexAttribArray(5);
+			glVertexAttribDivisor(5, 1);
+			glEnableVertexAttribArray(6);
+			glVertexAttribDivisor(6, 1);
+			glBindVertexArray(0);
+		}
+
+		//One layer per distinct texture; instances are sorted by layer so each layer is a contiguous range.
+		//With a texture array the layer is the tile's material and all layers share one texture.
+		layers.clear();
+		std::vector<int> tileLayers(tiles.size());
+		for (int i = 0; i < tiles.size(); i++)
+		{
+			if (arrayTexture != 0)
+			{
+				tileLayers[i] = tiles[i].GetMaterial();
+				if (tileLayers[i] >= layers.size())
+					layers.resize(tileLayers[i] + 1, arrayTexture);
+				continue;
+			}
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+			auto layer = std::find(layers.begin(), layers.end(), tiles[i].GetTexture());
+			tileLayers[i] = (int)(layer - layers.begin());
+			if (layer == layers.end())
+				layers.push_back(tiles[i].GetTexture());
+		}
+		textureArray = arrayTexture;
+
+		instances.resize(tiles.size());
+		instanceOfTile.resize(tiles.size());
+		firstInstance.assign(layers.size() + 1, 0);
+		for (int i = 0; i < tiles.size(); i++)
+			firstInstance[tileLayers[i] + 1]++;
+		for (int l = 0; l < layers.size(); l++)
+			firstInstance[l + 1] += firstInstance[l];
+
+		std::vector<int> next(firstInstance.begin(), firstInstance.end() - 1);
+		for (int i = 0; i < tiles.size(); i++)
+		{
+			instanceOfTile[i] = next[tileLayers[i]]++;
+			instances[instanceOfTile[i]] = MakeInstance(tiles[i], tileLayers[i]);
+		}
 
-		stbi_image_free(data);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(TileInstance), instances.empty() ? NULL : &instances[0], GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
 	}
 
-	return textureID;
-}
+	//Call after moving or resizing a tile
+	void UpdateTile(int tile, rectangularPrism& prism)
+	{
+		int instance = instanceOfTile[tile];
+		instances[instance] = MakeInstance(prism, (int)instances[instance].origin.w);
+
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		glBufferSubData(GL_ARRAY_BUFFER, instance * sizeof(TileInstance), sizeof(TileInstance), &instances[instance]);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void Draw()
+	{
+		if (!cube)
+			return;
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindVertexArray(cube->VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+
+		//The shader picks the layer, so every instance goes out in one call
+		if (textureArray != 0)
+		{
+			glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(TileInstance), (void*)offsetof(TileInstance, origin));
+			glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, sizeof(TileInstance), (void*)offsetof(TileInstance, size));
+			glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+			glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)cube->indices.size(), GL_UNSIGNED_INT, 0, (GLsizei)instances.size());
+		}
+
+		for (int l = 0; textureArray == 0 && l < layers.size(); l++)
+		{
+			//Point the per-instance attributes at the start of this layer's range
+			size_t offset = firstInstance[l] * sizeof(TileInstance);
+			glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(TileInstance), (void*)(offset + offsetof(TileInstance, origin)));
+			glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, sizeof(TileInstance), (void*)(offset + offsetof(TileInstance, size)));
+
+			glBindTexture(GL_TEXTURE_2D, layers[l]);
+			glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)cube->indices.size(), GL_UNSIGNED_INT, 0, firstInstance[l + 1] - firstInstance[l]);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+	}
+
+	void Delete()
+	{
+		if (cube)
+			cube->Delete();
+		delete cube;
+		cube = nullptr;
+		glDeleteBuffers(1, &instanceVBO);
+		instanceVBO = 0;
+	}
+
+private:
+	struct TileInstance {
+		glm::vec4 origin;	//xyz: minimum corner, w: texture layer
+		glm::vec3 size;
+	};
+
+	static TileInstance MakeInstance(rectangularPrism& tile, int layer)
+	{
+		TileInstance instance;
+		instance.origin = glm::vec4(tile.x, tile.y, tile.z, (float)layer);
+		instance.size = glm::vec3(tile.length, tile.width, tile.height);
+		return instance;
+	}
+
+	Mesh* cube = nullptr;
+	GLuint instanceVBO = 0;
+	std::vector<TileInstance> instances;
+	std::vector<int> instanceOfTile;
+	std::vector<int> firstInstance;
+	std::vector<GLuint> layers;
+	GLuint textureArray = 0;
+};
 
 struct KeyPosition
 {
@@ -753,6 +1356,14 @@ struct KeyScale
 	float timeStamp;
 };
 
+//Last keyframe used for each track of a bone. Owned by the animator so clips can be shared.
+struct BoneCursor
+{
+	int position;
+	int rotation;
+	int scale;
+};
+
 class Bone
 {
 public:
@@ -797,11 +1408,31 @@ public:
 		}
 	}
 
-	void Update(float animationTime)
+	//Reads a track written by Cook
+	Bone(CookedReader& reader)
+		: m_LocalTransform(1.0f)
+	{
+		reader.ReadString(m_Name);
+		reader.Read(m_ID);
+		m_NumPositions = ReadKeys(reader, m_Positions);
+		m_NumRotations = ReadKeys(reader, m_Rotations);
+		m_NumScalings = ReadKeys(reader, m_Scales);
+	}
+
+	void Cook(CookedWriter& writer) const
+	{
+		writer.WriteString(m_Name);
+		writer.Write(m_ID);
+		WriteKeys(writer, m_Positions);
+		WriteKeys(writer, m_Rotations);
+		WriteKeys(writer, m_Scales);
+	}
+
+	void Update(float animationTime, BoneCursor& cursor)
 	{
-		glm::mat4 translation = InterpolatePosition(animationTime);
-		glm::mat4 rotation = InterpolateRotation(animationTime);
-		glm::mat4 scale = InterpolateScaling(animationTime);
+		glm::mat4 translation = InterpolatePosition(animationTime, cursor.position);
+		glm::mat4 rotation = InterpolateRotation(animationTime, cursor.rotation);
+		glm::mat4 scale = InterpolateScaling(animationTime, cursor.scale);
 		m_LocalTransform = translation * rotation * scale;
 	}
 	glm::mat4 GetLocalTransform() { return m_LocalTransform; }
@@ -810,38 +1441,69 @@ public:
 
 
 
-	int GetPositionIndex(float animationTime)
+	int GetPositionIndex(float animationTime, int& cursor)
 	{
-		for (int index = 0; index < m_NumPositions - 1; ++index)
-		{
-			if (animationTime < m_Positions[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		return FindKeyIndex(m_Positions, animationTime, cursor);
 	}
 
-	int GetRotationIndex(float animationTime)
+	int GetRotationIndex(float animationTime, int& cursor)
 	{
-		for (int index = 0; index < m_NumRotations - 1; ++index)
-		{
-			if (animationTime < m_Rotations[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		return FindKeyIndex(m_Rotations, animationTime, cursor);
 	}
 
-	int GetScaleIndex(float animationTime)
+	int GetScaleIndex(float animationTime, int& cursor)
+	{
+		return FindKeyIndex(m_Scales, animationTime, cursor);
+	}
+
+
+private:
+
+	//Returns the key that starts the interval containing animationTime (clamped to the first/last interval).
+	//Playback normally moves forward by less than a key per frame, so the search resumes from the cursor
+	//and only falls back to a binary search when the time jumps (looping or switching clips).
+	template<typename Key>
+	static int FindKeyIndex(const std::vector<Key>& keys, float animationTime, int& cursor)
 	{
-		for (int index = 0; index < m_NumScalings - 1; ++index)
+		int last = (int)keys.size() - 2;
+		if (last <= 0)
+			return cursor = 0;
+
+		int index = std::min(std::max(cursor, 0), last);
+		if (keys[index].timeStamp <= animationTime)
 		{
-			if (animationTime < m_Scales[index + 1].timeStamp)
-				return index;
+			for (int step = 0; step < 2 && index < last && animationTime >= keys[index + 1].timeStamp; step++)
+				index++;
+			if (index == last || animationTime < keys[index + 1].timeStamp)
+				return cursor = index;
 		}
-		assert(0);
+
+		auto next = std::upper_bound(keys.begin() + 1, keys.begin() + last + 1, animationTime,
+			[](float time, const Key& key)
+			{
+				return time < key.timeStamp;
+			}
+		);
+		return cursor = (int)(next - keys.begin()) - 1;
 	}
 
+	template<typename Key>
+	static int ReadKeys(CookedReader& reader, std::vector<Key>& keys)
+	{
+		unsigned int count = 0;
+		reader.Read(count);
+		const Key* data = reader.ReadArray<Key>(count);
+		if (data != nullptr)
+			keys.assign(data, data + count);
+		return (int)keys.size();
+	}
 
-private:
+	template<typename Key>
+	static void WriteKeys(CookedWriter& writer, const std::vector<Key>& keys)
+	{
+		writer.Write((unsigned int)keys.size());
+		writer.WriteArray(keys.data(), keys.size());
+	}
 
 	float GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime)
 	{
@@ -849,15 +1511,16 @@ private:
 		float midWayLength = animationTime - lastTimeStamp;
 		float framesDiff = nextTimeStamp - lastTimeStamp;
 		scaleFactor = midWayLength / framesDiff;
-		return scaleFactor;
+		//Hold the first/last key outside the track's time range
+		return glm::clamp(scaleFactor, 0.0f, 1.0f);
 	}
 
-	glm::mat4 InterpolatePosition(float animationTime)
+	glm::mat4 InterpolatePosition(float animationTime, int& cursor)
 	{
 		if (1 == m_NumPositions)
 			return glm::translate(glm::mat4(1.0f), m_Positions[0].position);
 
-		int p0Index = GetPositionIndex(animationTime);
+		int p0Index = GetPositionIndex(animationTime, cursor);
 		int p1Index = p0Index + 1;
 		float scaleFactor = GetScaleFactor(m_Positions[p0Index].timeStamp,
 			m_Positions[p1Index].timeStamp, animationTime);
@@ -866,7 +1529,7 @@ private:
 		return glm::translate(glm::mat4(1.0f), finalPosition);
 	}
 
-	glm::mat4 InterpolateRotation(float animationTime)
+	glm::mat4 InterpolateRotation(float animationTime, int& cursor)
 	{
 		if (1 == m_NumRotations)
 		{
@@ -874,7 +1537,7 @@ private:
 			return glm::mat4(rotation);
 		}
 
-		int p0Index = GetRotationIndex(animationTime);
+		int p0Index = GetRotationIndex(animationTime, cursor);
 		int p1Index = p0Index + 1;
 		float scaleFactor = GetScaleFactor(m_Rotations[p0Index].timeStamp,
 			m_Rotations[p1Index].timeStamp, animationTime);
@@ -885,12 +1548,12 @@ private:
 
 	}
 
-	glm::mat4 InterpolateScaling(float animationTime)
+	glm::mat4 InterpolateScaling(float animationTime, int& cursor)
 	{
 		if (1 == m_NumScalings)
 			return glm::scale(glm::mat4(1.0f), m_Scales[0].scale);
 
-		int p0Index = GetScaleIndex(animationTime);
+		int p0Index = GetScaleIndex(animationTime, cursor);
 		int p1Index = p0Index + 1;
 		float scaleFactor = GetScaleFactor(m_Scales[p0Index].timeStamp,
 			m_Scales[p1Index].timeStamp, animationTime);
@@ -919,6 +1582,16 @@ struct AssimpNodeData
 	std::vector<AssimpNodeData> children;
 };
 
+//One node of the hierarchy flattened in depth-first order, so a parent always comes before its children
+struct SkeletonNode
+{
+	glm::mat4 transformation;
+	glm::mat4 offset;
+	int parent;		//index into the skeleton, -1 for the root
+	int channel;	//index into the animation's bones, -1 if the node is not animated
+	int boneIndex;	//index into the final bone matrices, -1 if no vertices are bound to the node
+};
+
 class Animation
 {
 public:
@@ -927,18 +1600,73 @@ public:
 	Animation(const std::string& animationPath, Model* model, int animationNum)
 	{
 		Assimp::Importer importer;
-		const aiScene* scene = importer.ReadFile(animationPath, aiProcess_Triangulate);
+		const aiScene* scene = MappedIOSystem::ReadFile(importer, animationPath, aiProcess_Triangulate);
 		assert(scene && scene->mRootNode);
-		auto animation = scene->mAnimations[animationNum];
-		m_Duration = animation->mDuration;
-		m_TicksPerSecond = animation->mTicksPerSecond;
-		aiMatrix4x4 globalTransformation = scene->mRootNode->mTransformation;
-		globalTransformation = globalTransformation.Inverse();
-		ReadHierarchyData(m_RootNode, scene->mRootNode);
-		ReadMissingBones(animation, *model);
+		Load(scene, scene->mAnimations[animationNum], model);
 	}
 
-	~Animation()
+	Animation(const aiScene* scene, const aiAnimation* animation, Model* model)
+	{
+		assert(scene && scene->mRootNode);
+		Load(scene, animation, model);
+	}
+
+	//Reads a clip written by Cook; every clip of a model shares the hierarchy, which is stored once
+	Animation(const AssimpNodeData& root, CookedReader& reader, Model* model)
+	{
+		unsigned int boneMapSize = 0, channelCount = 0;
+		reader.Read(m_Duration);
+		reader.Read(m_TicksPerSecond);
+		reader.Read(boneMapSize);
+		reader.Read(channelCount);
+
+		m_RootNode = root;
+		m_Bones.reserve(channelCount);
+		for (unsigned int i = 0; i < channelCount && reader.IsValid(); i++)
+			m_Bones.push_back(Bone(reader));
+
+		//Bone IDs are handed out in order as clips load, so the table this clip saw is every ID below its size
+		for (auto& bone : model->GetBoneInfoMap())
+			if (bone.second.id < (int)boneMapSize)
+				m_BoneInfoMap.insert(bone);
+
+		CompileSkeleton(m_RootNode, -1);
+	}
+
+	void Cook(CookedWriter& writer) const
+	{
+		writer.Write(m_Duration);
+		writer.Write(m_TicksPerSecond);
+		writer.Write((unsigned int)m_BoneInfoMap.size());
+		writer.Write((unsigned int)m_Bones.size());
+		for (const Bone& bone : m_Bones)
+			bone.Cook(writer);
+	}
+
+	static void CookNode(CookedWriter& writer, const AssimpNodeData& node)
+	{
+		writer.WriteString(node.name);
+		writer.Write(node.transformation);
+		writer.Write(node.childrenCount);
+		for (int i = 0; i < node.childrenCount; i++)
+			CookNode(writer, node.children[i]);
+	}
+
+	static void ReadNode(CookedReader& reader, AssimpNodeData& node)
+	{
+		node.childrenCount = 0;
+		reader.ReadString(node.name);
+		reader.Read(node.transformation);
+		reader.Read(node.childrenCount);
+		if (!reader.IsValid())
+			node.childrenCount = 0;
+
+		node.children.resize(node.childrenCount);
+		for (int i = 0; i < node.childrenCount && reader.IsValid(); i++)
+			ReadNode(reader, node.children[i]);
+	}
+
+	~Animation()
 	{
 	}
 
@@ -962,8 +1690,21 @@ public:
 	{
 		return m_BoneInfoMap;
 	}
+	inline const std::vector<SkeletonNode>& GetSkeleton() { return m_Skeleton; }
+	inline std::vector<Bone>& GetBones() { return m_Bones; }
 
 private:
+	void Load(const aiScene* scene, const aiAnimation* animation, Model* model)
+	{
+		m_Duration = animation->mDuration;
+		m_TicksPerSecond = animation->mTicksPerSecond;
+		aiMatrix4x4 globalTransformation = scene->mRootNode->mTransformation;
+		globalTransformation = globalTransformation.Inverse();
+		ReadHierarchyData(m_RootNode, scene->mRootNode);
+		ReadMissingBones(animation, *model);
+		CompileSkeleton(m_RootNode, -1);
+	}
+
 	void ReadMissingBones(const aiAnimation* animation, Model& model)
 	{
 		int size = animation->mNumChannels;
@@ -1004,34 +1745,127 @@ private:
 			dest.children.push_back(newData);
 		}
 	}
+
+	//Resolves every name lookup of the hierarchy once, so evaluating a pose needs no strings or hashing
+	void CompileSkeleton(const AssimpNodeData& node, int parent)
+	{
+		SkeletonNode flat;
+		flat.transformation = node.transformation;
+		flat.offset = glm::mat4(1.0f);
+		flat.parent = parent;
+		flat.channel = -1;
+		flat.boneIndex = -1;
+
+		for (int i = 0; i < m_Bones.size(); i++)
+		{
+			if (m_Bones[i].GetBoneName() == node.name)
+			{
+				flat.channel = i;
+				break;
+			}
+		}
+
+		auto boneInfo = m_BoneInfoMap.find(node.name);
+		if (boneInfo != m_BoneInfoMap.end() && boneInfo->second.id < MAX_BONES)
+		{
+			flat.boneIndex = boneInfo->second.id;
+			flat.offset = boneInfo->second.offset;
+		}
+
+		int index = (int)m_Skeleton.size();
+		m_Skeleton.push_back(flat);
+
+		for (int i = 0; i < node.childrenCount; i++)
+			CompileSkeleton(node.children[i], index);
+	}
+
 	float m_Duration;
 	int m_TicksPerSecond;
 	std::vector<Bone> m_Bones;
 	AssimpNodeData m_RootNode;
 	std::unordered_map<std::string, BoneInfo> m_BoneInfoMap;
+	std::vector<SkeletonNode> m_Skeleton;
+};
+
+//Every clip of a scene, built up front so switching clips needs no file I/O or allocation
+class AnimationLibrary
+{
+public:
+	AnimationLibrary(const aiScene* scene, Model* model)
+	{
+		PROFILE_ZONE("AnimationLibrary::AnimationLibrary");
+		m_Clips.reserve(scene->mNumAnimations);
+		for (unsigned int i = 0; i < scene->mNumAnimations; i++)
+			m_Clips.push_back(Animation(scene, scene->mAnimations[i], model));
+	}
+
+	//Reads the hierarchy and clips written by Cook
+	AnimationLibrary(CookedReader& reader, Model* model)
+	{
+		PROFILE_ZONE("AnimationLibrary::AnimationLibrary");
+		AssimpNodeData root;
+		Animation::ReadNode(reader, root);
+
+		unsigned int clipCount = 0;
+		reader.Read(clipCount);
+		for (unsigned int i = 0; i < clipCount && reader.IsValid(); i++)
+			m_Clips.push_back(Animation(root, reader, model));
+	}
+
+	void Cook(CookedWriter& writer)
+	{
+		Animation::CookNode(writer, m_Clips.empty() ? AssimpNodeData() : m_Clips[0].GetRootNode());
+		writer.Write((unsigned int)m_Clips.size());
+		for (const Animation& clip : m_Clips)
+			clip.Cook(writer);
+	}
+
+	Animation* GetClip(int index)
+	{
+		if (index < 0 || index >= (int)m_Clips.size())
+			return nullptr;
+		return &m_Clips[index];
+	}
+	int GetClipCount() { return (int)m_Clips.size(); }
+
+private:
+	std::vector<Animation> m_Clips;
 };
 
 class Animator
 {
 public:
+	Animator(AnimationLibrary* library, int clipIndex)
+		: Animator(library->GetClip(clipIndex))
+	{
+		m_Library = library;
+		m_CurrentClip = clipIndex;
+
+		//Size the per-clip state for the largest clip now, so PlayClip never allocates
+		for (int i = 0; i < library->GetClipCount(); i++)
+			Reserve(library->GetClip(i));
+	}
+
 	Animator(Animation* animation)
 	{
 		m_CurrentTime = 0.0;
-		m_CurrentAnimation = animation;
+		m_CurrentAnimation = nullptr;
+		PlayAnimation(animation);
 
-		m_FinalBoneMatrices.reserve(100);
+		m_FinalBoneMatrices.reserve(MAX_BONES);
 
-		for (int i = 0; i < 100; i++)
+		for (int i = 0; i < MAX_BONES; i++)
 			m_FinalBoneMatrices.push_back(glm::mat4(1.0f));
 	}
 
 	void UpdateAnimation(float dt)
 	{
+		PROFILE_ZONE("Animator::UpdateAnimation");
 		if (m_CurrentAnimation)
 		{
 			m_CurrentTime += m_CurrentAnimation->GetTicksPerSecond() * dt;
 			m_CurrentTime = fmod(m_CurrentTime, m_CurrentAnimation->GetDuration());
-			CalculateBoneTransform(&m_CurrentAnimation->GetRootNode(), glm::mat4(1.0f));
+			EvaluateSkeleton();
 		}
 	}
 
@@ -1039,8 +1873,23 @@ public:
 	{
 		m_CurrentAnimation = pAnimation;
 		m_CurrentTime = 0.0f;
+
+		if (pAnimation)
+		{
+			Reserve(pAnimation);
+			std::fill(m_Cursors.begin(), m_Cursors.end(), BoneCursor{ 0, 0, 0 });
+		}
+	}
+
+	void PlayClip(int clipIndex)
+	{
+		assert(m_Library);
+		PlayAnimation(m_Library->GetClip(clipIndex));
+		m_CurrentClip = clipIndex;
 	}
 
+	int GetCurrentClip() { return m_CurrentClip; }
+
 	void CalculateBoneTransform(const AssimpNodeData* node, glm::mat4 parentTransform)
 	{
 		std::string nodeName = node->name;
@@ -1050,7 +1899,7 @@ public:
 
 		if (Bone)
 		{
-			Bone->Update(m_CurrentTime);
+			Bone->Update(m_CurrentTime, m_Cursors[Bone - &m_CurrentAnimation->GetBones()[0]]);
 			nodeTransform = Bone->GetLocalTransform();
 		}
 
@@ -1068,14 +1917,54 @@ public:
 			CalculateBoneTransform(&node->children[i], globalTransformation);
 	}
 
-	std::vector<glm::mat4> GetFinalBoneMatrices()
+	//Same result as CalculateBoneTransform from the root, as one loop over the flattened skeleton
+	void EvaluateSkeleton()
+	{
+		const std::vector<SkeletonNode>& skeleton = m_CurrentAnimation->GetSkeleton();
+		std::vector<Bone>& bones = m_CurrentAnimation->GetBones();
+
+		for (int i = 0; i < skeleton.size(); i++)
+		{
+			const SkeletonNode& node = skeleton[i];
+			glm::mat4 nodeTransform = node.transformation;
+
+			if (node.channel >= 0)
+			{
+				bones[node.channel].Update(m_CurrentTime, m_Cursors[node.channel]);
+				nodeTransform = bones[node.channel].GetLocalTransform();
+			}
+
+			if (node.parent >= 0)
+				m_GlobalTransforms[i] = m_GlobalTransforms[node.parent] * nodeTransform;
+			else
+				m_GlobalTransforms[i] = nodeTransform;
+
+			if (node.boneIndex >= 0)
+				m_FinalBoneMatrices[node.boneIndex] = m_GlobalTransforms[i] * node.offset;
+		}
+	}
+
+	const std::vector<glm::mat4>& GetFinalBoneMatrices()
 	{
 		return m_FinalBoneMatrices;
 	}
 
 private:
+	//Grows the scratch buffers to fit a clip; clips of one model share a hierarchy so this rarely allocates
+	void Reserve(Animation* pAnimation)
+	{
+		if (m_GlobalTransforms.size() < pAnimation->GetSkeleton().size())
+			m_GlobalTransforms.resize(pAnimation->GetSkeleton().size());
+		if (m_Cursors.size() < pAnimation->GetBones().size())
+			m_Cursors.resize(pAnimation->GetBones().size(), BoneCursor{ 0, 0, 0 });
+	}
+
 	std::vector<glm::mat4> m_FinalBoneMatrices;
+	std::vector<glm::mat4> m_GlobalTransforms;
+	std::vector<BoneCursor> m_Cursors;
 	Animation* m_CurrentAnimation;
+	AnimationLibrary* m_Library = nullptr;
+	int m_CurrentClip = -1;
 	float m_CurrentTime;
 
 };
@@ -1142,10 +2031,13 @@ std::vector<float> skyboxVertices = {
 };
 
 Model *player;
-Animation *animation;
+AnimationLibrary *animations;
 Animator *animator;
 
 std::vector<rectangularPrism> floorTiles;
+LevelBatch levelBatch;
+TileInstancer tileInstancer;
+TileGrid tileGrid;
 
 /*=================================================================================================
 	HELPER FUNCTIONS
@@ -1181,6 +2073,19 @@ GLuint loadSkybox(std::vector<const char*> faces)
 	int width, height, nrChannels;
 	for (int i = 0; i < faces.size(); i++)
 	{
+		//Cooked faces need no decoding, so they go up right away
+		size_t cookedSize;
+		const unsigned char* cooked = assets.Find(faces[i], ASSET_TEXTURE, cookedSize);
+		if (cooked && UploadCookedTexture(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, cooked, cookedSize))
+			continue;
+
+		//The cube map samples black until all six faces have arrived
+		if (textureLoader.IsRunning())
+		{
+			textureLoader.Load(textureID, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, faces[i]);
+			continue;
+		}
+
 		unsigned char* data = stbi_load(faces[i], &width, &height, &nrChannels, 0);
 		if (data)
 		{
@@ -1203,6 +2108,68 @@ GLuint loadSkybox(std::vector<const char*> faces)
 	return textureID;
 }
 
+//Per-draw lighting constants, computed once on the CPU instead of for every fragment
+struct LightingParams {
+	glm::mat4 modelView;
+	glm::mat3 normalMatrix;
+	glm::vec3 lightPosition;	//view space
+};
+
+//The light sits at (3, 0, 3) in the space of whatever is being drawn
+LightingParams ComputeLighting(const glm::mat4& view, const glm::mat4& model)
+{
+	LightingParams params;
+	params.modelView = view * model;
+	params.normalMatrix = glm::transpose(glm::inverse(glm::mat3(params.modelView)));
+	params.lightPosition = glm::vec3(params.modelView * glm::vec4(3.0f, 0.0f, 3.0f, 1.0f));
+	return params;
+}
+
+void SetLighting(ShaderProgram& shader, const LightingParams& params)
+{
+	shader.SetUniform("modelViewMatrix", glm::value_ptr(params.modelView), 4, GL_FALSE, 1);
+	shader.SetUniform("normalMatrix", glm::value_ptr(params.normalMatrix), 3, GL_FALSE, 1);
+	shader.SetUniform("lightPosition", params.lightPosition.x, params.lightPosition.y, params.lightPosition.z);
+	shader.SetUniform("lightAmbient", 0.7f, 0.7f, 0.7f, 1.0f);
+	shader.SetUniform("lightDiffuse", 0.7f, 0.7f, 0.7f, 1.0f);
+	shader.SetUniform("lightSpecular", 1.0f, 1.0f, 1.0f, 1.0f);
+	shader.SetUniform("materialSpecular", 1.0f, 1.0f, 1.0f, 1.0f);
+	shader.SetUniform("materialShininess", 32.0f);
+}
+
+//Sends the first boneCount matrices of the palette in a single glUniformMatrix call
+void UploadBonePalette(ShaderProgram& shader, const std::vector<glm::mat4>& transforms, int boneCount)
+{
+	PROFILE_ZONE("UploadBonePalette");
+	GLsizei count = (GLsizei)std::min(std::min(boneCount, MAX_BONES), (int)transforms.size());
+	if (count <= 0)
+		return;
+
+	if (compactBonePalette)
+	{
+		//Bone matrices are affine, so the last row is always (0, 0, 0, 1) and can be dropped
+		compactBoneMatrices.resize(count * 3);
+		for (int i = 0; i < count; i++)
+		{
+			const glm::mat4& m = transforms[i];
+			for (int row = 0; row < 3; row++)
+				compactBoneMatrices[i * 3 + row] = glm::vec4(m[0][row], m[1][row], m[2][row], m[3][row]);
+		}
+		shader.SetUniform("finalBonesMatrices", glm::value_ptr(compactBoneMatrices[0]), 3, 4, GL_FALSE, count);
+	}
+	else
+		shader.SetUniform("finalBonesMatrices", glm::value_ptr(transforms[0]), 4, GL_FALSE, count);
+}
+
+//Seconds since start. Headless runs and fast replays use a virtual clock advanced every display, so
+//they simulate the same timeline regardless of how fast the frames render
+double FrameClock()
+{
+	if (headless || replayFast)
+		return virtualClock;
+	return glfwGetTime();
+}
+
 void restartGame() {
 	player_pos = glm::vec3(0.0f, 0.0f, 0.0f);
 	camera_direction_vector = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -1210,7 +2177,8 @@ void restartGame() {
 	direction_vector1 = glm::vec3(0.0f, 0.0f, 0.0f);
 	direction_vector2 = glm::vec3(0.0f, 0.0f, 0.0f);
 	respawn_point = glm::vec3(0.0f, 0.0f, 0.0f);
-	startTime = glfwGetTime();
+	previous_player_pos = player_pos;
+	startTime = simulationTime;
 	gameFinish = false;
 	livesCount = 3;
 	for (int i = 0; i < floorTiles.size(); i++)
@@ -1223,15 +2191,16 @@ void restartGame() {
 
 void CreateTransformationMatrices( void )
 {
+	PROFILE_ZONE("CreateTransformationMatrices");
 	// PROJECTION MATRIX
 	PerspProjectionMatrix = glm::perspective<float>( glm::radians( 60.0f ), (float)WindowWidth / (float)WindowHeight, 0.01f, 1000.0f );
 
 	// VIEW MATRIX
-	glm::vec3 player_center(player_pos.x, player_pos.y + 10.0f, player_pos.z);
+	glm::vec3 player_center(render_player_pos.x, render_player_pos.y + 10.0f, render_player_pos.z);
 	direction = glm::vec3(cos(glm::radians(yaw)) * cos(glm::radians(pitch)), sin(glm::radians(pitch)), sin(glm::radians(yaw)) * cos(glm::radians(pitch)));
-	eye.x = player_pos.x + ((10.0 + 1.5*pitch) * direction.x);
-	eye.y = player_pos.y + ((10.0 + 1.5*pitch) * direction.y);
-	eye.z = player_pos.z + ((10.0 + 1.5*pitch) * direction.z);
+	eye.x = render_player_pos.x + ((10.0 + 1.5*pitch) * direction.x);
+	eye.y = render_player_pos.y + ((10.0 + 1.5*pitch) * direction.y);
+	eye.z = render_player_pos.z + ((10.0 + 1.5*pitch) * direction.z);
 
 	PerspViewMatrix = glm::lookAt(eye, player_center, up);
 	SkyboxViewMatrix = glm::mat4(glm::mat3(PerspViewMatrix));
@@ -1245,10 +2214,24 @@ void CreateTransformationMatrices( void )
 
 void CreateShaders( void )
 {
+	//Linked programs are cached next to their sources and reloaded with glProgramBinary on later runs
+	ShaderProgram::SetBinaryCache(useShaderCache ? "./shaders/" : "");
+
 	// Renders using perspective projection
 	SkyboxShader.Create( "./shaders/skybox.vert", "./shaders/skybox.frag" );
 
-	PerspectiveShader.Create("./shaders/texpersplight.vert", "./shaders/texpersplight.frag");
+	//Level geometry uses the static variant, the player the skinned one; both are compiled up front
+	std::vector<std::string> features = { "SKINNED", "LIT", "TEXTURE_ARRAY" };
+	unsigned int tileFeatures = shadingFeatures | (textureArrayTiles ? SHADER_TEXTURE_ARRAY : 0);
+	std::string vertexDefines = packedVertices ? "#define OCTAHEDRAL_NORMALS\n" : "";
+	PerspectiveShaders.Create("./shaders/texpersplight.vert", "./shaders/texpersplight.frag", features,
+		vertexDefines + (compactBonePalette ? "#define COMPACT_BONE_PALETTE\n" : ""));
+	PerspectiveShaders.Get(tileFeatures);
+	PerspectiveShaders.Get(shadingFeatures | SHADER_SKINNED);
+
+	InstancedTileShaders.Create("./shaders/texpersplight_instanced.vert", "./shaders/texpersplight.frag", features, vertexDefines);
+	if (instancedTiles)
+		InstancedTileShaders.Get(tileFeatures);
 }
 
 /*=================================================================================================
@@ -1272,6 +2255,7 @@ void CreateSkyboxBuffers()
 
 void loadTiles()
 {
+	PROFILE_ZONE("loadTiles");
 	floorTiles.push_back(rectangularPrism(0, 0, 0, 1, 2, 1, false, false));
 	floorTiles.push_back(rectangularPrism(-2, 0, 0, 1, 2, 1, false, false));
 	floorTiles.push_back(rectangularPrism(-2, 0, -2, 1, 2, 1, false, false));
@@ -1286,7 +2270,7 @@ void loadTiles()
 	floorTiles.push_back(rectangularPrism(0, 4, -2, 1, 2, 1, false, false));
 	floorTiles.push_back(rectangularPrism(2, 4.25, -1, 1, 2, 1, false, false));
 	floorTiles.push_back(rectangularPrism(4, 5, 0, 1, 2, 1, false, false));
-	floorTiles.push_back(rectangularPrism(4, 6, 2, 1, 2, 1, false, false));
+	floorTiles.push_back(rectangularPrism(4, 6, 2, 1, 2, 1, false, false, MATERIAL_FRAGILE)); //Ledge above the drop
 	floorTiles.push_back(rectangularPrism(4, 1, 4, 1, 2, 1, true, false)); //Checkpoint 3 (Drop)
 	floorTiles.push_back(rectangularPrism(6, 1.5, 6, 1, 2, 1, false, false));
 	floorTiles.push_back(rectangularPrism(8, 2, 7, 1, 2, 1, false, false));
@@ -1304,10 +2288,28 @@ void loadTiles()
 	floorTiles.push_back(rectangularPrism(16, 7.5, 6, 1, 2, 1, false, false));
 	floorTiles.push_back(rectangularPrism(18, 8, 8, 1, 2, 1, false, false));
 	floorTiles.push_back(rectangularPrism(16, 8.5, 10, 1, 2, 1, false, false)); //End of spiral
-	floorTiles.push_back(rectangularPrism(16, 8.5, 12, 1, 2, 1, false, false));
-	floorTiles.push_back(rectangularPrism(16, 9, 14, 1, 2, 1, false, false));
-	floorTiles.push_back(rectangularPrism(16, 10, 16, 1, 2, 1, false, false));
+	floorTiles.push_back(rectangularPrism(16, 8.5, 12, 1, 2, 1, false, false, MATERIAL_ROAD)); //Road to the final jump
+	floorTiles.push_back(rectangularPrism(16, 9, 14, 1, 2, 1, false, false, MATERIAL_ROAD));
+	floorTiles.push_back(rectangularPrism(16, 10, 16, 1, 2, 1, false, false, MATERIAL_ROAD));
 	floorTiles.push_back(rectangularPrism(16, 0, 19, 1, 2, 1, true, true)); //Final jump + end goal
+
+	if (textureArrayTiles && floorMaterials.GetID() == 0)
+		floorMaterials.Create(std::vector<std::string>(std::begin(floorMaterialPaths), std::end(floorMaterialPaths)), 1024, &assets);
+
+	//Without the array (disabled, or it failed to load) every tile binds its own texture
+	if (floorMaterials.GetID() == 0)
+		for (int i = 0; i < floorTiles.size(); i++)
+			floorTiles[i].acquireTexture();
+
+	if (instancedTiles)
+		tileInstancer.Build(floorTiles, floorMaterials.GetID());
+	else
+		levelBatch.Build(floorTiles, floorMaterials.GetID());
+
+	std::vector<TileBounds> bounds;
+	for (int i = 0; i < floorTiles.size(); i++)
+		bounds.push_back(floorTiles[i].GetBounds());
+	tileGrid.Build(bounds, (float)tileScale);
 }
 
 void Draw(GLuint VAO, int size, GLenum primitive)
@@ -1319,11 +2321,13 @@ void Draw(GLuint VAO, int size, GLenum primitive)
 
 void checkCollision()
 {
+	PROFILE_ZONE("checkCollision");
 	bool collided = false;
 
 	if (player_pos.y < -50.0f)
 	{
 		player_pos = respawn_point;
+		previous_player_pos = player_pos;
 		livesCount--;
 		if (livesCount == 0)
 		{
@@ -1332,44 +2336,34 @@ void checkCollision()
 		}
 	}
 
-	for (int i = 0; i < floorTiles.size(); i++)
+	//Only the tiles sharing the player's grid cell are tested
+	int i = tileGrid.FindTile(player_pos);
+	if (i >= 0)
 	{
-		//Check that player is within x-axis bounds of tile
-		if (player_pos.x > floorTiles[i].minX() && player_pos.x < floorTiles[i].maxX())
-		{
-			//Check that player is within z-axis bounds of tile
-			if (player_pos.z > floorTiles[i].minZ() && player_pos.z < floorTiles[i].maxZ())
-			{
-				//Check if player has fallen into or is standing on the tile
-				if (player_pos.y > floorTiles[i].minY() && player_pos.y <= floorTiles[i].maxY())
-				{
-					player_pos.y = floorTiles[i].maxY();
-					jump_displacement = 0.0f;
-					fall_start = 0.0f;
-					jumping = false;
-					standing = true;
-					collided = true;
-
-					if (floorTiles[i].isCheckpoint && !floorTiles[i].checkpointReached)
-					{
-						float center_x = (floorTiles[i].maxX() + floorTiles[i].minX()) / 2.0f;
-						float center_y = floorTiles[i].maxY();
-						float center_z = (floorTiles[i].maxZ() + floorTiles[i].minZ()) / 2.0f;
-						livesCount = 3;
-						
-						respawn_point = glm::vec3(center_x, center_y, center_z);
-						floorTiles[i].checkpointReached = true;
-					}
-					if (floorTiles[i].isFinish && !floorTiles[i].checkpointReached) {
-						if (!gameFinish) {
-							std::cout << "Congratulations! Final time: " << glfwGetTime() - startTime << "seconds!" << std::endl;
-							std::cout << "Press the start button on your controller or 'x' on your keyboard to restart." << std::endl;
-							floorTiles[i].checkpointReached = true;
-						}
-					}
+		const TileBounds& tile = tileGrid.GetBounds(i);
 
-					break;
-				}
+		player_pos.y = tile.max.y;
+		jump_displacement = 0.0f;
+		fall_start = 0.0f;
+		jumping = false;
+		standing = true;
+		collided = true;
+
+		if (floorTiles[i].isCheckpoint && !floorTiles[i].checkpointReached)
+		{
+			float center_x = (tile.max.x + tile.min.x) / 2.0f;
+			float center_y = tile.max.y;
+			float center_z = (tile.max.z + tile.min.z) / 2.0f;
+			livesCount = 3;
+			
+			respawn_point = glm::vec3(center_x, center_y, center_z);
+			floorTiles[i].checkpointReached = true;
+		}
+		if (floorTiles[i].isFinish && !floorTiles[i].checkpointReached) {
+			if (!gameFinish) {
+				std::cout << "Congratulations! Final time: " << simulationTime - startTime << "seconds!" << std::endl;
+				std::cout << "Press the start button on your controller or 'x' on your keyboard to restart." << std::endl;
+				floorTiles[i].checkpointReached = true;
 			}
 		}
 	}
@@ -1378,82 +2372,80 @@ void checkCollision()
 	{
 		standing = false;
 		if (fall_start == 0.0f)
-			fall_start = glfwGetTime();
+			fall_start = simulationTime;
 	}
 }
 
+void SwitchAnimation(int clip)
+{
+	double switch_start = glfwGetTime();
+	animationNum = clip;
+	animator->PlayClip(clip);
+	double switch_time = glfwGetTime() - switch_start;
+
+	animationSwitchCount++;
+	animationSwitchTotal += switch_time;
+	if (switch_time > animationSwitchMax)
+		animationSwitchMax = switch_time;
+}
+
 void GamepadInput()
 {
+	PROFILE_ZONE("GamepadInput");
 	camera_direction_vector = glm::normalize(glm::cross(glm::vec3(cos(glm::radians(yaw)), 0, sin(glm::radians(yaw))), up));
 
-	if (axes[2] > 0.05 || axes[2] < -0.05)
-		yaw += axes[2];
-	if (axes[3] > 0.1 || axes[3] < -0.1)
-		pitch += axes[3];
+	if (stepGamepad.axes[2] > 0.05 || stepGamepad.axes[2] < -0.05)
+		yaw += stepGamepad.axes[2];
+	if (stepGamepad.axes[3] > 0.1 || stepGamepad.axes[3] < -0.1)
+		pitch += stepGamepad.axes[3];
 
 	if (pitch > 70.0)
 		pitch = 70.0;
 	if (pitch < 7.0)
 		pitch = 7.0;
 
-	if (axes[0] > 0.05 || axes[0] < -0.05)
+	if (stepGamepad.axes[0] > 0.05 || stepGamepad.axes[0] < -0.05)
 	{
-		direction_vector1 = axes[0] / 2.0f * camera_direction_vector;
+		direction_vector1 = stepGamepad.axes[0] / 2.0f * camera_direction_vector;
 		player_pos -= direction_vector1;
 		if (animationNum != 8 && !jumping)
 		{
-			delete animation;
-			delete animator;
-			animationNum = 8;
-			animation = new Animation("models/player.glb", player, animationNum);
-			animator = new Animator(animation);
+			SwitchAnimation(8);
 		}
 	}
-	if (axes[1] > 0.1 || axes[1] < -0.1)
+	if (stepGamepad.axes[1] > 0.1 || stepGamepad.axes[1] < -0.1)
 	{
-		direction_vector2 = axes[1] / 2.0f * glm::vec3(cos(glm::radians(yaw)), 0, sin(glm::radians(yaw)));
+		direction_vector2 = stepGamepad.axes[1] / 2.0f * glm::vec3(cos(glm::radians(yaw)), 0, sin(glm::radians(yaw)));
 		player_pos += direction_vector2;
 		if (animationNum != 8 && !jumping)
 		{
-			delete animation;
-			delete animator;
-			animationNum = 8;
-			animation = new Animation("models/player.glb", player, animationNum);
-			animator = new Animator(animation);
+			SwitchAnimation(8);
 		}
 	}
-	if (axes[0] < 0.05 && axes[0] > -0.05 && axes[1] < 0.1 && axes[1] > -0.1)
+	if (stepGamepad.axes[0] < 0.05 && stepGamepad.axes[0] > -0.05 && stepGamepad.axes[1] < 0.1 && stepGamepad.axes[1] > -0.1)
 	{
 		if (animationNum != 6 && !jumping)
 		{
-			delete animation;
-			delete animator;
-			animationNum = 6;
-			animation = new Animation("models/player.glb", player, animationNum);
-			animator = new Animator(animation);
+			SwitchAnimation(6);
 		}
 	}
 
 	//Only allows jump if player is not already jumping and is standing on ground
-	if (GLFW_PRESS == buttons[0] && !jumping && standing)
+	if (GLFW_PRESS == stepGamepad.buttons[0] && !jumping && standing)
 	{
-		jump_start = glfwGetTime();
+		jump_start = simulationTime;
 		jump_velocity = sqrt(gravity * jump_height) / 2.0f;
 		jumping = true;
 		standing = false;
 		player_pos.y += 0.1f;
 
-		delete animation;
-		delete animator;
-		animationNum = 7;
-		animation = new Animation("models/player.glb", player, animationNum);
-		animator = new Animator(animation);
+		SwitchAnimation(7);
 	}
 
-	if (GLFW_PRESS == buttons[7])
+	if (GLFW_PRESS == stepGamepad.buttons[7])
 		restartGame();
 
-	float current_time = glfwGetTime();
+	float current_time = simulationTime;
 
 	checkCollision();
 
@@ -1486,6 +2478,105 @@ void GamepadInput()
 		player_direction_vector = (-direction_vector1 + direction_vector2) * glm::vec3(0.5, 0, 0.5);
 }
 
+//Copies the live gamepad into the snapshot the next simulation step reads
+void SampleGamepad(bool gamepad)
+{
+	stepGamepad = GamepadSnapshot();
+	stepGamepad.connected = gamepad;
+	if (!gamepad)
+		return;
+
+	if (axes == NULL || buttons == NULL)
+	{
+		axes = glfwGetJoystickAxes(GLFW_JOYSTICK_1, &axis_count);
+		buttons = glfwGetJoystickButtons(GLFW_JOYSTICK_1, &button_count);
+	}
+	for (int i = 0; i < std::min(axis_count, GamepadSnapshot::MaxAxes); i++)
+		stepGamepad.axes[i] = axes[i];
+	for (int i = 0; i < std::min(button_count, GamepadSnapshot::MaxButtons); i++)
+		stepGamepad.buttons[i] = buttons[i];
+}
+
+void ApplyKey(unsigned char key);
+void ApplySpecialKey(int key);
+
+//Reports whether the replay reproduced its recording and hands control back to live input
+void FinishReplay()
+{
+	inputReplay.Verify(std::cout);
+	inputReplay.Close();
+
+	if (replayFast)
+	{
+		replayFast = false;
+		if (!headless)
+			framePacer.SetMode(pacingMode, targetFrameRate);
+	}
+	lastSimulationUpdate = FrameClock();
+	lastFrameAnim = FrameClock();
+	simulationAccumulator = 0.0;
+}
+
+//Runs as many fixed physics steps as the wall-clock time since the last call covers, then interpolates
+//the rendered player position between the last two steps
+void UpdateSimulation(bool gamepad)
+{
+	PROFILE_ZONE("UpdateSimulation");
+	double now = FrameClock();
+	simulationAccumulator += now - lastSimulationUpdate;
+	lastSimulationUpdate = now;
+
+	int steps = 0;
+	while (simulationAccumulator >= SimulationStep && steps < MaxStepsPerFrame)
+	{
+		if (inputReplay.IsReplaying() && inputReplay.IsFinished(simulationSteps))
+		{
+			FinishReplay();
+			break;
+		}
+
+		previous_player_pos = player_pos;
+		simulationTime += SimulationStep;
+
+		//Input for this step comes from the recording when replaying, from the devices otherwise
+		if (inputReplay.IsReplaying())
+		{
+			pendingKeys = inputReplay.BeginStep(simulationSteps);
+			stepGamepad = inputReplay.GetGamepad();
+		}
+		else
+			SampleGamepad(gamepad);
+
+		inputRecorder.RecordStep(simulationSteps, pendingKeys, stepGamepad);
+		for (int i = 0; i < pendingKeys.size(); i++)
+		{
+			if (pendingKeys[i].type == INPUT_KEY)
+				ApplyKey((unsigned char)pendingKeys[i].key);
+			else
+				ApplySpecialKey(pendingKeys[i].key);
+		}
+		pendingKeys.clear();
+
+		if (stepGamepad.connected)
+			GamepadInput();
+
+		inputRecorder.EndStep(player_pos);
+		inputReplay.EndStep(player_pos);
+		simulationSteps++;
+
+		simulationAccumulator -= SimulationStep;
+		steps++;
+	}
+
+	//Drop the backlog after a long stall instead of fast-forwarding through it; keeping a whole step
+	//would only run it at the start of the next frame and snap the interpolation back
+	if (steps == MaxStepsPerFrame && simulationAccumulator >= SimulationStep)
+		simulationAccumulator = 0.0;
+
+	float alpha = (float)(simulationAccumulator / SimulationStep);
+	render_player_pos = glm::mix(previous_player_pos, player_pos, alpha);
+}
+
 /*=================================================================================================
 	CALLBACKS
 =================================================================================================*/
@@ -1498,12 +2589,8 @@ void GamepadInput()
 
 void idle_func()
 {
-	float currentFrame = glfwGetTime();
-	if (currentFrame - lastFrame > 0.0055)
-	{
-		lastFrame = currentFrame;
-		glutPostRedisplay();
-	}
+	framePacer.WaitForNextFrame();
+	glutPostRedisplay();
 }
 
 void reshape_func( int width, int height )
@@ -1531,6 +2618,66 @@ void keyboard_func( unsigned char key, int x, int y )
 			break;
 		}
 
+		//Gameplay keys take effect at the next simulation step (live input is ignored while replaying)
+		case 'a':
+		case 'w':
+		case 's':
+		case 'd':
+		case 'x':
+		case ' ':
+		{
+			if (!inputReplay.IsReplaying())
+				pendingKeys.push_back(InputEvent{ INPUT_KEY, key });
+			break;
+		}
+
+		case 't':
+		{
+			std::cout << respawn_point.x << ", " << respawn_point.y << ", " << respawn_point.z << std::endl;
+			break;
+		}
+
+		case 'y':
+		{
+			std::cout << glfwGetTime() << std::endl;
+			break;
+		}
+
+		case 'p':
+		{
+			std::cout << "Animation switches: " << animationSwitchCount;
+			if (animationSwitchCount > 0)
+				std::cout << ", avg " << animationSwitchTotal / animationSwitchCount * 1000.0 << " ms, max " << animationSwitchMax * 1000.0 << " ms";
+			std::cout << std::endl;
+			framePacer.PrintStats(std::cout);
+			framePacer.ResetStats();
+			gpuTimer.PrintStats(std::cout);
+			break;
+		}
+
+		case 'u':
+		{
+			ShaderProgram& skinnedShader = PerspectiveShaders.Get(shadingFeatures | SHADER_SKINNED);
+			std::cout << "Uniform location cache: " << skinnedShader.GetUniformCacheHits() << " hits, "
+				<< skinnedShader.GetUniformCacheMisses() << " misses" << std::endl;
+			skinnedShader.ResetUniformCacheStats();
+			break;
+		}
+
+		// Exit on escape key press
+		case '\x1B':
+		{
+			exit( EXIT_SUCCESS );
+			break;
+		}
+	}
+}
+
+//Gameplay effect of a key, applied by UpdateSimulation at the start of a step
+void ApplyKey(unsigned char key)
+{
+	switch (key)
+	{
 		case 'a':
 		{
 			yaw += 2.0;
@@ -1557,36 +2704,17 @@ void keyboard_func( unsigned char key, int x, int y )
 			break;
 		}
 
-		case 't':
-		{
-			std::cout << respawn_point.x << ", " << respawn_point.y << ", " << respawn_point.z << std::endl;
-			break;
-		}
-
 		case 'x':
 		{
 			restartGame();
 			break;
 		}
 
-		case 'y':
-		{
-			std::cout << glfwGetTime() << std::endl;
-			break;
-		}
-
 		case ' ':
 		{
 			player_pos = glm::vec3(0.0, 0.0, 0.0);
 			break;
 		}
-
-		// Exit on escape key press
-		case '\x1B':
-		{
-			exit( EXIT_SUCCESS );
-			break;
-		}
 	}
 }
 
@@ -1598,6 +2726,13 @@ void key_released( unsigned char key, int x, int y )
 void key_special_pressed( int key, int x, int y )
 {
 	key_special_states[ key ] = true;
+	if (!inputReplay.IsReplaying())
+		pendingKeys.push_back(InputEvent{ INPUT_SPECIAL_KEY, key });
+}
+
+//Gameplay effect of an arrow key, applied by UpdateSimulation at the start of a step
+void ApplySpecialKey(int key)
+{
 	//Up arrow
 	if (key == 101)
 	{
@@ -1675,10 +2810,20 @@ void active_motion_func( int x, int y )
 void deletePointers()
 {
 	delete player;
-	delete animation;
+	delete animations;
 	delete animator;
+	levelBatch.Delete();
+	tileInstancer.Delete();
+	gpuTimer.Delete();
+	textureLoader.Delete();
+	floorMaterials.Delete();
+	PerspectiveShaders.Delete();
+	InstancedTileShaders.Delete();
 	for (int i = 0; i < floorTiles.size(); i++)
-		floorTiles[i].deleteMesh();
+		floorTiles[i].releaseTexture();
+	Shader::SetArchive(nullptr);
+	Textures.SetArchive(nullptr);
+	assets.Close();
 }
 
 /*=================================================================================================
@@ -1687,9 +2832,23 @@ void deletePointers()
 
 void display_func(void)
 {
+	PROFILE_ZONE("Frame");
+
 	// Clear the contents of the back buffer
 
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	{
+		PROFILE_ZONE("TextureUploads");
+		textureLoader.Update(textureUploadBudget);
+	}
+
+	//A fast replay feeds the simulation the most steps it takes per frame
+	if (headless || replayFast)
+		virtualClock += replayFast ? MaxStepsPerFrame * SimulationStep : 1.0 / targetFrameRate;
+
+	UpdateSimulation(glfwGetGamepadState(GLFW_JOYSTICK_1, &state) == GLFW_TRUE);
+
 	if (gameFinish == false) {
 		// Update transformation matrices
 		CreateTransformationMatrices();
@@ -1700,39 +2859,47 @@ void display_func(void)
 		else
 			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
-		float currentFrameAnim = glfwGetTime();
+		float currentFrameAnim = FrameClock();
 		deltaTime = currentFrameAnim - lastFrameAnim;
 		lastFrameAnim = currentFrameAnim;
 		//Pause animation while in mid-air
-		if (glfwGetTime() - jump_start < 0.3 || !jumping)
+		if (simulationTime - jump_start < 0.3 || !jumping)
 			animator->UpdateAnimation(deltaTime);
 
 
-		PerspectiveShader.Use();
-		PerspectiveShader.SetUniform("projectionMatrix", glm::value_ptr(PerspProjectionMatrix), 4, GL_FALSE, 1);
-		PerspectiveShader.SetUniform("viewMatrix", glm::value_ptr(PerspViewMatrix), 4, GL_FALSE, 1);
-		PerspectiveShader.SetUniform("modelMatrix", glm::value_ptr(PerspModelMatrix), 4, GL_FALSE, 1);
-
-		for (int i = 0; i < floorTiles.size(); i++) {
-			floorTiles[i].Draw();
-		}
-
-		auto transforms = animator->GetFinalBoneMatrices();
-		for (int i = 0; i < transforms.size(); i++)
+		//Tiles only need the MVP transform; the bone loop runs for the player alone
 		{
-			std::string temp = "finalBonesMatrices[" + std::to_string(i) + "]";
-			GLchar* finalBonesMatrices = (GLchar*)temp.c_str();
-			PerspectiveShader.SetUniform(finalBonesMatrices, glm::value_ptr(transforms[i]), 4, GL_FALSE, 1);
+			PROFILE_ZONE("DrawTiles");
+			gpuTimer.Begin(PASS_TILES);
+			unsigned int tileFeatures = shadingFeatures | (floorMaterials.GetID() != 0 ? SHADER_TEXTURE_ARRAY : 0);
+			ShaderProgram& tileShader = instancedTiles ? InstancedTileShaders.Get(tileFeatures) : PerspectiveShaders.Get(tileFeatures);
+			tileShader.Use();
+			tileShader.SetUniform("projectionMatrix", glm::value_ptr(PerspProjectionMatrix), 4, GL_FALSE, 1);
+			SetLighting(tileShader, ComputeLighting(PerspViewMatrix, PerspModelMatrix));
+			if (instancedTiles)
+				tileInstancer.Draw();
+			else
+				levelBatch.Draw();
+			gpuTimer.End(PASS_TILES);
 		}
 
-		if (glfwGetGamepadState(GLFW_JOYSTICK_1, &state))
-			GamepadInput();
+		gpuTimer.Begin(PASS_PLAYER);
+		ShaderProgram& skinnedShader = PerspectiveShaders.Get(shadingFeatures | SHADER_SKINNED);
+		skinnedShader.Use();
+		skinnedShader.SetUniform("projectionMatrix", glm::value_ptr(PerspProjectionMatrix), 4, GL_FALSE, 1);
+		UploadBonePalette(skinnedShader, animator->GetFinalBoneMatrices(), player->GetBoneCount());
 
-		PerspModelMatrix *= glm::inverse(glm::lookAt(player_pos, player_pos - player_direction_vector, up));
-		PerspModelMatrix = glm::scale(PerspModelMatrix, glm::vec3(4.0f, 4.0f, 4.0f));
-		PerspectiveShader.SetUniform("modelMatrix", glm::value_ptr(PerspModelMatrix), 4, GL_FALSE, 1);
-		player->Draw();
+		{
+			PROFILE_ZONE("DrawPlayer");
+			PerspModelMatrix *= glm::inverse(glm::lookAt(render_player_pos, render_player_pos - player_direction_vector, up));
+			PerspModelMatrix = glm::scale(PerspModelMatrix, glm::vec3(4.0f, 4.0f, 4.0f));
+			SetLighting(skinnedShader, ComputeLighting(PerspViewMatrix, PerspModelMatrix));
+			player->Draw();
+		}
+		gpuTimer.End(PASS_PLAYER);
 
+		PROFILE_ZONE("DrawSkybox");
+		gpuTimer.Begin(PASS_SKYBOX);
 		SkyboxShader.Use();
 		SkyboxShader.SetUniform("projectionMatrix", glm::value_ptr(PerspProjectionMatrix), 4, GL_FALSE, 1);
 		SkyboxShader.SetUniform("viewMatrix", glm::value_ptr(SkyboxViewMatrix), 4, GL_FALSE, 1);
@@ -1742,11 +2909,9 @@ void display_func(void)
 		glBindTexture(GL_TEXTURE_CUBE_MAP, skybox);
 		Draw(skybox_VAO, 36, GL_TRIANGLES);
 		glDepthFunc(GL_LESS);
+		gpuTimer.End(PASS_SKYBOX);
 	}
 	else {
-		if (glfwGetGamepadState(GLFW_JOYSTICK_1, &state)) {
-			GamepadInput();
-		}
 		if (livesCount == 0) {
 			glClearColor(0.7f, 0.0f, 0.0f, 1.0f);
 		}
@@ -1756,17 +2921,371 @@ void display_func(void)
 	}
 	// Swap the front and back buffers
 
-	glutSwapBuffers();
+	if (!headless)
+	{
+		PROFILE_ZONE("SwapBuffers");
+		glutSwapBuffers();
+	}
+	gpuTimer.EndFrame();
+	framePacer.FrameFinished();
 
 
 }
 
+/*=================================================================================================
+	MODEL CACHE
+=================================================================================================*/
+
+//Bump when Vertex, the keyframe structs or the order of the cooked sections change
+const char CookedModelMagic[8] = { 'C', 'K', 'M', 'O', 'D', 'E', 'L', 0 };
+const unsigned int CookedModelVersion = 2;
+
+struct CookedModelHeader
+{
+	char magic[8];
+	unsigned int version;
+	unsigned int vertexSize;
+	unsigned long long sourceHash;
+	unsigned long long sourceSize;
+};
+
+//Builds the model and its clips from a cooked blob. A nonzero sourceSize also requires the blob to have been
+//cooked from that source; archive blobs skip the check, AssetArchive::Find already drops stale ones.
+bool ReadCookedModel(const std::string& path, const unsigned char* data, size_t size, Model*& model, AnimationLibrary*& library,
+	unsigned long long sourceHash = 0, size_t sourceSize = 0)
+{
+	CookedReader reader(data, size);
+	CookedModelHeader header;
+	if (!reader.Read(header) || memcmp(header.magic, CookedModelMagic, sizeof(CookedModelMagic)) != 0 || header.version != CookedModelVersion
+		|| header.vertexSize != sizeof(Vertex))
+		return false;
+	if (sourceSize != 0 && (header.sourceHash != sourceHash || header.sourceSize != sourceSize))
+		return false;
+
+	model = new Model(reader, path);
+	library = new AnimationLibrary(reader, model);
+	if (reader.IsValid())
+		return true;
+
+	std::cout << "Cooked model " << path << " is corrupt, reimporting" << std::endl;
+	delete library;
+	delete model;
+	model = nullptr;
+	library = nullptr;
+	return false;
+}
+
+//Maps a cooked model and builds the model and its clips from it, if it was cooked from the given source
+bool LoadCookedModel(const std::string& path, const std::string& cachePath, unsigned long long sourceHash, size_t sourceSize, Model*& model, AnimationLibrary*& library)
+{
+	PROFILE_ZONE("LoadCookedModel");
+
+	MappedFile cache;
+	if (!cache.Open(cachePath))
+		return false;
+
+	return ReadCookedModel(path, cache.GetData(), cache.GetSize(), model, library, sourceHash, sourceSize);
+}
+
+//Writes the blob ReadCookedModel reads
+void WriteCookedModel(CookedWriter& writer, const aiScene* scene, Model* model, AnimationLibrary* library, unsigned long long sourceHash, size_t sourceSize)
+{
+	CookedModelHeader header = {};
+	memcpy(header.magic, CookedModelMagic, sizeof(CookedModelMagic));
+	header.version = CookedModelVersion;
+	header.vertexSize = sizeof(Vertex);
+	header.sourceHash = sourceHash;
+	header.sourceSize = sourceSize;
+
+	writer.Write(header);
+	model->Cook(writer, scene);
+	library->Cook(writer);
+}
+
+//Loads a model and all of its clips from the asset archive when its entry is current, or else from path + ".cooked" when that was cooked
+//from the current source file. Otherwise imports the source with Assimp and, if useCache is set, cooks it for the next start.
+bool LoadModel(const std::string& path, Model*& model, AnimationLibrary*& library, bool useCache)
+{
+	PROFILE_ZONE("LoadModel");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	size_t archivedSize;
+	const unsigned char* archived = useCache ? assets.Find(path, ASSET_MODEL, archivedSize) : nullptr;
+	if (archived && ReadCookedModel(path, archived, archivedSize, model, library))
+	{
+		std::cout << "Model " << path << ": loaded from the asset archive in "
+			<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms\n";
+		return true;
+	}
+
+	//The import below reads the same mapping
+	std::shared_ptr<MappedFile> source = MappedIOSystem::Map(path);
+	if (!source)
+	{
+		std::cout << "ERROR::MODEL::Cannot open " << path << std::endl;
+		return false;
+	}
+	unsigned long long sourceHash = HashBytes(source->GetData(), source->GetSize());
+	std::string cachePath = path + ".cooked";
+
+	if (useCache && LoadCookedModel(path, cachePath, sourceHash, source->GetSize(), model, library))
+	{
+		std::cout << "Model " << path << ": loaded from cache in "
+			<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms\n";
+		return true;
+	}
+
+	Assimp::Importer importer;
+	const aiScene* scene;
+	{
+		PROFILE_ZONE("Assimp::ReadFile");
+		scene = MappedIOSystem::ReadFile(importer, path, aiProcess_Triangulate);
+	}
+	if (!scene || !scene->mRootNode)
+	{
+		std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
+		return false;
+	}
+	model = new Model(scene, path);
+	library = new AnimationLibrary(scene, model);
+
+	double importTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Model " << path << ": imported in " << importTime << " ms";
+
+	if (useCache)
+	{
+		PROFILE_ZONE("CookModel");
+		CookedWriter writer;
+		WriteCookedModel(writer, scene, model, library, sourceHash, source->GetSize());
+		if (writer.Save(cachePath))
+			std::cout << ", cooked to " << cachePath << " (" << writer.GetSize() / 1024 << " KB)";
+		else
+			std::cout << ", could not write " << cachePath;
+	}
+	std::cout << "\n";
+
+	return true;
+}
+
+/*=================================================================================================
+	ASSET COOKING
+=================================================================================================*/
+
+//Asset cooker step for models: the same blob as the .cooked cache. The model is imported CPU-only, so no GL context is needed.
+bool CookModelAsset(const std::string& path, const unsigned char* data, size_t size, std::vector<unsigned char>& cooked)
+{
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFileFromMemory(data, size, aiProcess_Triangulate, path.substr(path.find_last_of('.') + 1).c_str());
+	if (!scene || !scene->mRootNode)
+	{
+		std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
+		return false;
+	}
+
+	Model* model = new Model(scene, path, true);
+	AnimationLibrary* library = new AnimationLibrary(scene, model);
+	CookedWriter writer;
+	WriteCookedModel(writer, scene, model, library, HashBytes(data, size), size);
+	cooked.assign(writer.GetData(), writer.GetData() + writer.GetSize());
+
+	delete library;
+	delete model;
+	return true;
+}
+
+//Cooks models/, textures/ and shaders/ into the asset archive, rebuilding only assets whose source changed
+bool CookAssets()
+{
+	//The cooked layout is part of the version, so models are recooked when it changes
+	AssetCooker cooker;
+	cooker.AddType(".glb", ASSET_MODEL, CookedModelVersion * 1000 + sizeof(Vertex), CookModelAsset);
+	cooker.AddDirectory("models");
+	cooker.AddDirectory("textures");
+	cooker.AddDirectory("shaders");
+	return cooker.Cook(assetArchivePath);
+}
+
+/*=================================================================================================
+	BENCHMARKS
+=================================================================================================*/
+
+//Seconds on the steady clock; benchmarks run before GLFW is up in headless runs, where glfwGetTime returns 0
+double BenchmarkClock()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//Times the recursive CalculateBoneTransform against the flattened EvaluateSkeleton on the same pose
+void BenchmarkSkeleton(int iterations)
+{
+	Animation* clip = animations->GetClip(animationNum);
+	Animator bench(clip);
+	bench.UpdateAnimation(0.25f);
+
+	double start = BenchmarkClock();
+	for (int i = 0; i < iterations; i++)
+		bench.CalculateBoneTransform(&clip->GetRootNode(), glm::mat4(1.0f));
+	double recursive = BenchmarkClock() - start;
+	std::vector<glm::mat4> reference = bench.GetFinalBoneMatrices();
+
+	start = BenchmarkClock();
+	for (int i = 0; i < iterations; i++)
+		bench.EvaluateSkeleton();
+	double flattened = BenchmarkClock() - start;
+
+	float maxError = 0.0f;
+	const std::vector<glm::mat4>& result = bench.GetFinalBoneMatrices();
+	for (int b = 0; b < result.size(); b++)
+		for (int c = 0; c < 4; c++)
+			for (int r = 0; r < 4; r++)
+				maxError = std::max(maxError, std::abs(result[b][c][r] - reference[b][c][r]));
+
+	std::cout << "Skeleton evaluation (" << clip->GetSkeleton().size() << " nodes, " << iterations << " iterations)\n";
+	std::cout << "  recursive: " << recursive / iterations * 1000000.0 << " us/pose\n";
+	std::cout << "  flattened: " << flattened / iterations * 1000000.0 << " us/pose\n";
+	std::cout << "  speedup:   " << recursive / flattened << "x, max difference " << maxError << std::endl;
+}
+
+//Times TileGrid::FindTile against a linear scan over synthetic levels of increasing size
+void BenchmarkCollision()
+{
+	const int sizes[] = { 1000, 100000, 1000000 };
+	const int queries = 100000;
+	std::mt19937 rng(170);
+
+	for (int size : sizes)
+	{
+		//Course-sized tiles on a square layout with random heights
+		int side = (int)std::ceil(std::sqrt((float)size));
+		float spacing = 2.0f * tileScale;
+		std::uniform_real_distribution<float> height(0.0f, 10.0f * tileScale);
+		std::vector<TileBounds> bounds(size);
+		for (int i = 0; i < size; i++)
+		{
+			bounds[i].min = glm::vec3((i % side) * spacing, height(rng), (i / side) * spacing);
+			bounds[i].max = bounds[i].min + glm::vec3((float)tileScale, 2.0f, (float)tileScale);
+		}
+
+		std::uniform_real_distribution<float> across(0.0f, side * spacing);
+		std::uniform_real_distribution<float> up(0.0f, 10.0f * tileScale + 2.0f);
+		std::vector<glm::vec3> points(queries);
+		for (int q = 0; q < queries; q++)
+			points[q] = glm::vec3(across(rng), up(rng), across(rng));
+
+		TileGrid grid;
+		double start = BenchmarkClock();
+		grid.Build(bounds, (float)tileScale);
+		double build = BenchmarkClock() - start;
+
+		int hits = 0;
+		start = BenchmarkClock();
+		for (int q = 0; q < queries; q++)
+			hits += grid.FindTile(points[q]) >= 0;
+		double gridTime = BenchmarkClock() - start;
+
+		//The linear scan is what checkCollision used to do; sample fewer queries on big levels
+		int linearQueries = std::max(100, queries / (size / 1000));
+		int mismatches = 0;
+		start = BenchmarkClock();
+		for (int q = 0; q < linearQueries; q++)
+		{
+			int found = -1;
+			for (int i = 0; i < size; i++)
+			{
+				if (PointOnTile(points[q], bounds[i]))
+				{
+					found = i;
+					break;
+				}
+			}
+			mismatches += found != grid.FindTile(points[q]);
+		}
+		double linearTime = BenchmarkClock() - start;
+
+		std::cout << "Collision, " << size << " tiles: build " << build * 1000.0 << " ms, grid "
+			<< gridTime / queries * 1000000000.0 << " ns/query (" << hits << " hits), linear "
+			<< linearTime / linearQueries * 1000000.0 << " us/query, " << mismatches << " mismatches" << std::endl;
+	}
+}
+
+//Times loading the player with Assimp against loading it from the cooked cache (warm: the files are in the OS cache)
+void BenchmarkModelLoad(int iterations)
+{
+	const char* path = "models/player.glb";
+	double times[2] = { 0.0, 0.0 };
+
+	for (int mode = 0; mode < 2; mode++)
+	{
+		for (int i = 0; i < iterations; i++)
+		{
+			Model* model = nullptr;
+			AnimationLibrary* library = nullptr;
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if (!LoadModel(path, model, library, mode == 1))
+				return;
+			times[mode] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			delete library;
+			delete model;
+		}
+	}
+
+	std::cout << "Model load (" << path << ", " << iterations << " iterations)\n";
+	std::cout << "  Assimp: " << times[0] / iterations << " ms\n";
+	std::cout << "  cooked: " << times[1] / iterations << " ms\n";
+	std::cout << "  speedup: " << times[0] / times[1] << "x" << std::endl;
+	MappedIOSystem::PrintStats(std::cout);
+	MappedIOSystem::ReleaseMappings();
+}
+
+//Renders a fixed number of frames (or, when replaying, until the replay ends) through display_func into
+//the headless framebuffer, optionally writing each one to disk, and reports the CPU + GPU time per frame
+void RunHeadless(int frames)
+{
+	std::vector<double> frameTimes;
+	frameTimes.reserve(frames);
+
+	bool replay = inputReplay.IsReplaying();
+	for (int i = 0; replay ? inputReplay.IsReplaying() : i < frames; i++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		display_func();
+		glFinish();
+		frameTimes.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+		if (!headlessDumpDir.empty())
+		{
+			char name[32];
+			snprintf(name, sizeof(name), "/frame_%05d.ppm", i);
+			headlessContext.SaveFrame(headlessDumpDir + name);
+		}
+	}
+
+	if (frameTimes.empty())
+		return;
+
+	double total = 0.0;
+	for (double t : frameTimes)
+		total += t;
+	std::sort(frameTimes.begin(), frameTimes.end());
+	frames = (int)frameTimes.size();
+
+	std::cout << "Headless: " << frames << " frames at " << headlessContext.GetWidth() << "x" << headlessContext.GetHeight() << "\n";
+	std::cout << "  mean " << total / frames * 1000.0 << " ms, p50 " << frameTimes[frames / 2] * 1000.0
+		<< " ms, p99 " << frameTimes[std::min(frames - 1, frames * 99 / 100)] * 1000.0 << " ms, max " << frameTimes.back() * 1000.0 << " ms\n";
+	std::cout << "  " << frames / total << " frames per second" << std::endl;
+	gpuTimer.PrintStats(std::cout);
+}
+
 /*=================================================================================================
 	INIT
 =================================================================================================*/
 
 void init( void )
 {
+	PROFILE_ZONE("init");
+
 	// Print some info
 	std::cout << "Vendor:         " << glGetString( GL_VENDOR   ) << "\n";
 	std::cout << "Renderer:       " << glGetString( GL_RENDERER ) << "\n";
@@ -1778,12 +3297,29 @@ void init( void )
 	glEnable( GL_DEPTH_TEST ); // enable depth test
 	glEnable( GL_CULL_FACE ); // enable back-face culling
 
+	//Read assets from the cooked archive when there is one
+	if (useAssetArchive && assets.Open(assetArchivePath))
+	{
+		Shader::SetArchive(&assets);
+		Textures.SetArchive(&assets);
+		std::cout << "Assets: " << assets.GetNumAssets() << " in " << assetArchivePath << " (" << assets.GetSize() / 1024 << " KB)\n";
+	}
+
 	// Create shaders
 	CreateShaders();
+	if (useShaderCache)
+		ShaderProgram::PrintBinaryCacheStats(std::cout);
 
 	//Create skybox buffers
 	CreateSkyboxBuffers();
 
+	//Images are decoded on worker threads from here on; the first frames may draw placeholders
+	if (asyncTextures)
+	{
+		textureLoader.Start();
+		Textures.SetLoader(&textureLoader);
+	}
+
 	//Load skybox textures
 	CreateTextures();
 
@@ -1794,13 +3330,29 @@ void init( void )
 		buttons = glfwGetJoystickButtons(GLFW_JOYSTICK_1, &button_count);
 	}
 
-	//Create player model and neutral animation
-	player = new Model("models/player.glb");
-	animation = new Animation("models/player.glb", player, animationNum);
-	animator = new Animator(animation);
+	//Create player model and all of its animation clips, from the cooked cache when it is current
+	if (!LoadModel("models/player.glb", player, animations, useModelCache))
+		exit(EXIT_FAILURE);
+	animator = new Animator(animations, animationNum);
+
+	//Every import is done; model files stay mapped only while something imports them
+	if (MappedIOSystem::GetNumScenes() > 0)
+		MappedIOSystem::PrintStats(std::cout);
+	MappedIOSystem::ReleaseMappings();
 
 	loadTiles();
 
+	gpuTimer.Create({ "GPU tiles", "GPU player", "GPU skybox" });
+
+	//Headless frames are compared and benchmarked, so they should never show placeholders
+	if (headless)
+		textureLoader.Finish();
+
+	lastSimulationUpdate = FrameClock();
+	if (!instancedTiles)
+		std::cout << "Level: " << floorTiles.size() << " tiles in " << levelBatch.GetDrawCalls() << " draw calls\n";
+	std::cout << "Vertex buffers: " << vertexBufferBytes / 1024 << " KB (" << unpackedVertexBytes / 1024 << " KB unpacked)\n";
+	std::cout << "Textures: " << Textures.GetNumTextures() << " loaded for " << Textures.GetNumRequests() << " requests\n";
 	std::cout << "Finished initializing...\n\n";
 }
 
@@ -1810,29 +3362,135 @@ void init( void )
 
 int main( int argc, char** argv )
 {
-	// Create and initialize the OpenGL context
-	glutInit( &argc, argv );
-
-	glutInitWindowPosition( 100, 100 );
-	glutInitWindowSize( InitWindowWidth, InitWindowHeight );
-	glutInitDisplayMode( GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH );
+	// Command-line options (read before glutInit, which cannot run without a display in headless mode)
+	for( int i = 1; i < argc; i++ )
+	{
+		if( strcmp( argv[i], "--compact-bones" ) == 0 )
+			compactBonePalette = true;
+		else if( strcmp( argv[i], "--bench-skeleton" ) == 0 )
+			benchmarkSkeleton = true;
+		else if( strcmp( argv[i], "--instanced-tiles" ) == 0 )
+			instancedTiles = true;
+		else if( strcmp( argv[i], "--bench-collision" ) == 0 )
+			benchmarkCollision = true;
+		else if( strcmp( argv[i], "--bench-model-load" ) == 0 )
+			benchmarkModelLoad = true;
+		else if( strcmp( argv[i], "--no-model-cache" ) == 0 )
+			useModelCache = false;
+		else if( strcmp( argv[i], "--full-vertices" ) == 0 )
+			packedVertices = false;
+		else if( strcmp( argv[i], "--no-shader-cache" ) == 0 )
+			useShaderCache = false;
+		else if( strcmp( argv[i], "--no-archive" ) == 0 )
+			useAssetArchive = false;
+		else if( strcmp( argv[i], "--cook-assets" ) == 0 )
+			cookAssets = true;
+		else if( strcmp( argv[i], "--no-texture-array" ) == 0 )
+			textureArrayTiles = false;
+		else if( strcmp( argv[i], "--sync-textures" ) == 0 )
+			asyncTextures = false;
+		else if( strcmp( argv[i], "--upload-budget" ) == 0 && i + 1 < argc )
+			textureUploadBudget = (size_t)atoi( argv[++i] ) * 1024;
+		else if( strcmp( argv[i], "--unlit" ) == 0 )
+			shadingFeatures &= ~SHADER_LIT;
+		else if( strcmp( argv[i], "--vsync" ) == 0 )
+			pacingMode = PACE_VSYNC;
+		else if( strcmp( argv[i], "--unlimited" ) == 0 )
+			pacingMode = PACE_UNLIMITED;
+		else if( strcmp( argv[i], "--fps" ) == 0 && i + 1 < argc )
+			targetFrameRate = atof( argv[++i] );
+		else if( strcmp( argv[i], "--headless" ) == 0 )
+			headless = true;
+		else if( strcmp( argv[i], "--frames" ) == 0 && i + 1 < argc )
+			headlessFrames = atoi( argv[++i] );
+		else if( strcmp( argv[i], "--dump-frames" ) == 0 && i + 1 < argc )
+			headlessDumpDir = argv[++i];
+		else if( strcmp( argv[i], "--record" ) == 0 && i + 1 < argc )
+			recordPath = argv[++i];
+		else if( strcmp( argv[i], "--replay" ) == 0 && i + 1 < argc )
+			replayPath = argv[++i];
+		else if( strcmp( argv[i], "--replay-fast" ) == 0 )
+			replayFast = true;
+		else if( strcmp( argv[i], "--profile" ) == 0 && i + 1 < argc )
+		{
+			i++;
+			if( Profiler::IsCompiledIn() )
+				Profiler::WriteOnExit( argv[i] );
+			else
+				std::cerr << "--profile ignored: built without ENABLE_PROFILER" << std::endl;
+		}
+	}
 
-	glutCreateWindow( "CSE-170 Computer Graphics" );
+	if( !replayPath.empty() )
+	{
+		if( !inputReplay.Open( replayPath, SimulationStep ) )
+			return -1;
+	}
+	else
+		replayFast = false;
 
-	// Initialize GLEW
-	GLenum ret = glewInit();
-	if( ret != GLEW_OK ) {
-		std::cerr << "GLEW initialization error." << std::endl;
-		glewGetErrorString( ret );
+	if( !recordPath.empty() && !inputRecorder.Open( recordPath, SimulationStep ) )
 		return -1;
+
+	// Cooking runs on the CPU only, so it needs neither a window nor a context
+	if( cookAssets )
+		return CookAssets() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	if( headless )
+	{
+		// Create a windowless context and initialize GLEW for it
+		if( !headlessContext.Create( InitWindowWidth, InitWindowHeight ) )
+			return -1;
+	}
+	else
+	{
+		// Create and initialize the OpenGL context
+		glutInit( &argc, argv );
+
+		glutInitWindowPosition( 100, 100 );
+		glutInitWindowSize( InitWindowWidth, InitWindowHeight );
+		glutInitDisplayMode( GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH );
+
+		glutCreateWindow( "CSE-170 Computer Graphics" );
+
+		// Initialize GLEW
+		GLenum ret = glewInit();
+		if( ret != GLEW_OK ) {
+			std::cerr << "GLEW initialization error." << std::endl;
+			glewGetErrorString( ret );
+			return -1;
+		}
 	}
 
 	//Initialize GLFW
-	glfwInit();
-	if (!glfwInit())
+#ifdef GLFW_PLATFORM_NULL
+	if( headless )
+		glfwInitHint( GLFW_PLATFORM, GLFW_PLATFORM_NULL );
+#endif
+	if( !glfwInit() )
 	{
+		// Headless runs only lose the gamepad; their clock does not come from GLFW
 		std::cerr << "GLFW initialization error." << std::endl;
-		return -1;
+		if( !headless )
+			return -1;
+	}
+
+	if( headless )
+	{
+		init();
+
+		if( benchmarkSkeleton )
+			BenchmarkSkeleton( 10000 );
+		if( benchmarkCollision )
+			BenchmarkCollision();
+		if( benchmarkModelLoad )
+			BenchmarkModelLoad( 20 );
+		RunHeadless( headlessFrames );
+
+		deletePointers();
+		headlessContext.Destroy();
+		glfwTerminate();
+		return EXIT_SUCCESS;
 	}
 
 	// Register callback functions
@@ -1850,6 +3508,22 @@ int main( int argc, char** argv )
 	// Do program initialization
 	init();
 
+	// Needs GLEW for the swap interval extension
+	framePacer.SetMode( replayFast ? PACE_UNLIMITED : pacingMode, targetFrameRate );
+
+	if( benchmarkSkeleton || benchmarkCollision || benchmarkModelLoad )
+	{
+		if( benchmarkSkeleton )
+			BenchmarkSkeleton( 10000 );
+		if( benchmarkCollision )
+			BenchmarkCollision();
+		if( benchmarkModelLoad )
+			BenchmarkModelLoad( 20 );
+		deletePointers();
+		glfwTerminate();
+		return EXIT_SUCCESS;
+	}
+
 	// Enter the main loop
 	glutMainLoop();
 
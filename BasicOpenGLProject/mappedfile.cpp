@@ -0,0 +1,141 @@
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*=================================================================================================
+  CONSTRUCTORS
+=================================================================================================*/
+
+MappedFile::MappedFile()
+{
+	Data = nullptr;
+	Size = 0;
+	Opened = false;
+
+#ifdef _WIN32
+	File = INVALID_HANDLE_VALUE;
+	Mapping = NULL;
+#endif
+}
+
+/*=================================================================================================
+  DESTRUCTOR
+=================================================================================================*/
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+/*=================================================================================================
+  OPEN
+=================================================================================================*/
+
+#ifdef _WIN32
+
+bool MappedFile::Open( const std::string& path )
+{
+	Close();
+
+	File = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( File == INVALID_HANDLE_VALUE )
+		return false;
+
+	LARGE_INTEGER size;
+	if( !GetFileSizeEx( File, &size ) )
+	{
+		Close();
+		return false;
+	}
+
+	Size = (size_t)size.QuadPart;
+	Opened = true;
+	if( Size == 0 )
+		return true;
+
+	Mapping = CreateFileMappingA( File, NULL, PAGE_READONLY, 0, 0, NULL );
+	if( Mapping != NULL )
+		Data = (const unsigned char*)MapViewOfFile( Mapping, FILE_MAP_READ, 0, 0, 0 );
+
+	if( Data == nullptr )
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::Close( void )
+{
+	if( Data != nullptr )
+		UnmapViewOfFile( Data );
+	if( Mapping != NULL )
+		CloseHandle( Mapping );
+	if( File != INVALID_HANDLE_VALUE )
+		CloseHandle( File );
+
+	File = INVALID_HANDLE_VALUE;
+	Mapping = NULL;
+	Data = nullptr;
+	Size = 0;
+	Opened = false;
+}
+
+#else
+
+bool MappedFile::Open( const std::string& path )
+{
+	Close();
+
+	int descriptor = open( path.c_str(), O_RDONLY );
+	if( descriptor < 0 )
+		return false;
+
+	struct stat info;
+	if( fstat( descriptor, &info ) != 0 )
+	{
+		close( descriptor );
+		return false;
+	}
+
+	Size = (size_t)info.st_size;
+	if( Size > 0 )
+	{
+		void* data = mmap( nullptr, Size, PROT_READ, MAP_PRIVATE, descriptor, 0 );
+		if( data == MAP_FAILED )
+		{
+			close( descriptor );
+			Size = 0;
+			return false;
+		}
+		Data = (const unsigned char*)data;
+	}
+
+	// The mapping keeps the file alive
+	close( descriptor );
+	Opened = true;
+
+	return true;
+}
+
+void MappedFile::Close( void )
+{
+	if( Data != nullptr )
+		munmap( (void*)Data, Size );
+
+	Data = nullptr;
+	Size = 0;
+	Opened = false;
+}
+
+#endif
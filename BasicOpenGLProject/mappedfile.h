@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile( const MappedFile& ) = delete;
+	MappedFile& operator=( const MappedFile& ) = delete;
+
+public:
+	/**
+	Maps a file into memory. Pages are read by the OS on first access.
+	*@param path Path of the file.
+	*@return True if the file exists and could be mapped (an empty file maps to no data).
+	**/
+	bool Open( const std::string& path );
+
+	void Close();
+
+public:
+	bool                 IsOpen()  const { return Opened; }
+	const unsigned char* GetData() const { return Data;   }
+	size_t               GetSize() const { return Size;   }
+
+private:
+	const unsigned char* Data;
+	size_t Size;
+	bool Opened;
+
+#ifdef _WIN32
+	void* File;
+	void* Mapping;
+#endif
+};
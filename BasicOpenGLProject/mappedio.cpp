@@ -0,0 +1,159 @@
+#include "mappedio.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+std::map<std::string, std::shared_ptr<MappedFile>> MappedIOSystem::Mappings;
+int MappedIOSystem::Scenes = 0;
+int MappedIOSystem::FilesMapped = 0;
+int MappedIOSystem::MappingsShared = 0;
+size_t MappedIOSystem::BytesMapped = 0;
+size_t MappedIOSystem::BytesRead = 0;
+double MappedIOSystem::IoMs = 0.0;
+double MappedIOSystem::ParseMs = 0.0;
+
+/*=================================================================================================
+  STREAM
+=================================================================================================*/
+
+MappedIOStream::MappedIOStream( std::shared_ptr<MappedFile> file )
+{
+	File = file;
+	Position = 0;
+}
+
+size_t MappedIOStream::Read( void* buffer, size_t size, size_t count )
+{
+	if( size == 0 )
+		return 0;
+
+	// Whole elements only, like fread
+	auto start = std::chrono::steady_clock::now();
+	count = std::min( count, ( File->GetSize() - Position ) / size );
+	if( count > 0 )
+		memcpy( buffer, File->GetData() + Position, size * count );
+	Position += size * count;
+
+	MappedIOSystem::BytesRead += size * count;
+	MappedIOSystem::IoMs += std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+	return count;
+}
+
+size_t MappedIOStream::Write( const void* buffer, size_t size, size_t count )
+{
+	return 0;
+}
+
+aiReturn MappedIOStream::Seek( size_t offset, aiOrigin origin )
+{
+	size_t base = origin == aiOrigin_SET ? 0 : origin == aiOrigin_CUR ? Position : File->GetSize();
+	if( offset > File->GetSize() - base )
+		return aiReturn_FAILURE;
+
+	Position = base + offset;
+	return aiReturn_SUCCESS;
+}
+
+size_t MappedIOStream::Tell( void ) const
+{
+	return Position;
+}
+
+size_t MappedIOStream::FileSize( void ) const
+{
+	return File->GetSize();
+}
+
+void MappedIOStream::Flush( void )
+{
+}
+
+/*=================================================================================================
+  FILE SYSTEM
+=================================================================================================*/
+
+bool MappedIOSystem::Exists( const char* path ) const
+{
+	return Map( path ) != nullptr;
+}
+
+char MappedIOSystem::getOsSeparator( void ) const
+{
+	return '/';
+}
+
+Assimp::IOStream* MappedIOSystem::Open( const char* path, const char* mode )
+{
+	if( strchr( mode, 'w' ) != nullptr || strchr( mode, 'a' ) != nullptr )
+		return nullptr;
+
+	std::shared_ptr<MappedFile> file = Map( path );
+	return file != nullptr ? new MappedIOStream( file ) : nullptr;
+}
+
+void MappedIOSystem::Close( Assimp::IOStream* stream )
+{
+	delete stream;
+}
+
+std::shared_ptr<MappedFile> MappedIOSystem::Map( const std::string& path )
+{
+	auto start = std::chrono::steady_clock::now();
+
+	std::string key = path;
+	std::replace( key.begin(), key.end(), '\\', '/' );
+
+	std::shared_ptr<MappedFile> file;
+	auto found = Mappings.find( key );
+	if( found != Mappings.end() )
+	{
+		file = found->second;
+		MappingsShared++;
+	}
+	else
+	{
+		file = std::make_shared<MappedFile>();
+		if( file->Open( key ) )
+		{
+			Mappings[key] = file;
+			FilesMapped++;
+			BytesMapped += file->GetSize();
+		}
+		else
+			file = nullptr;
+	}
+
+	IoMs += std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+	return file;
+}
+
+/*=================================================================================================
+  READ FILE
+=================================================================================================*/
+
+const aiScene* MappedIOSystem::ReadFile( Assimp::Importer& importer, const std::string& path, unsigned int flags )
+{
+	auto start = std::chrono::steady_clock::now();
+	double ioBefore = IoMs;
+
+	importer.SetIOHandler( new MappedIOSystem() );
+	const aiScene* scene = importer.ReadFile( path, flags );
+
+	double totalMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+	ParseMs += totalMs - ( IoMs - ioBefore );
+	Scenes++;
+
+	return scene;
+}
+
+void MappedIOSystem::ReleaseMappings( void )
+{
+	Mappings.clear();
+}
+
+void MappedIOSystem::PrintStats( std::ostream& out )
+{
+	out << "Assimp I/O: " << Scenes << " scenes, " << FilesMapped << " files mapped (" << MappingsShared << " opens shared a mapping), "
+		<< BytesMapped / 1024 << " KB mapped, " << BytesRead / 1024 << " KB read; "
+		<< IoMs << " ms I/O, " << ParseMs << " ms parsing\n";
+}
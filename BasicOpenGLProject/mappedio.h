@@ -0,0 +1,75 @@
+#pragma once
+
+#include <assimp/Importer.hpp>
+#include <assimp/IOSystem.hpp>
+#include <assimp/IOStream.hpp>
+#include <memory>
+#include <string>
+#include <map>
+#include <ostream>
+#include "mappedfile.h"
+
+// Assimp stream over a mapped file; reads copy straight out of the mapped pages
+class MappedIOStream : public Assimp::IOStream
+{
+public:
+	MappedIOStream( std::shared_ptr<MappedFile> file );
+
+public:
+	size_t   Read( void* buffer, size_t size, size_t count ) override;
+	size_t   Write( const void* buffer, size_t size, size_t count ) override;
+	aiReturn Seek( size_t offset, aiOrigin origin ) override;
+	size_t   Tell() const override;
+	size_t   FileSize() const override;
+	void     Flush() override;
+
+private:
+	std::shared_ptr<MappedFile> File;
+	size_t Position;
+};
+
+// Assimp file system that opens files as shared mappings. Every instance draws on the same set of
+// mappings, so importers of the same path in a row map it once. Read-only.
+class MappedIOSystem : public Assimp::IOSystem
+{
+public:
+	bool             Exists( const char* path ) const override;
+	char             getOsSeparator() const override;
+	Assimp::IOStream* Open( const char* path, const char* mode = "rb" ) override;
+	void             Close( Assimp::IOStream* stream ) override;
+
+public:
+	/**
+	Imports a scene through a MappedIOSystem and adds the time spent to the statistics.
+	*@param importer Importer to read with; it takes over a new MappedIOSystem.
+	*@param path Path of the file.
+	*@param flags Assimp post-processing flags.
+	*@return The scene, owned by the importer, or nullptr on failure.
+	**/
+	static const aiScene* ReadFile( Assimp::Importer& importer, const std::string& path, unsigned int flags );
+
+	/**
+	Returns the shared mapping of a file, mapping it on first use.
+	*@return The mapping, or nullptr if the file cannot be opened.
+	**/
+	static std::shared_ptr<MappedFile> Map( const std::string& path );
+
+	// Unmaps files once no stream uses them any more; call when the imports are done
+	static void ReleaseMappings();
+
+	// Prints bytes mapped and read, and the I/O and parsing time of ReadFile so far
+	static void PrintStats( std::ostream& out );
+	static int  GetNumScenes() { return Scenes; }
+
+private:
+	static std::map<std::string, std::shared_ptr<MappedFile>> Mappings;
+	static int Scenes;
+	static int FilesMapped;
+	static int MappingsShared;
+	static size_t BytesMapped;
+	static size_t BytesRead;
+	static double IoMs;
+	static double ParseMs;
+
+	friend class MappedIOStream;
+};
@@ -0,0 +1,156 @@
+#include "materialarray.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+
+static long long GreatestCommonDivisor( long long a, long long b )
+{
+	while( b != 0 )
+	{
+		long long t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+// Smallest size every value divides, or the largest value if that exceeds the limit
+static int CommonSize( const std::vector<int>& values, int limit )
+{
+	long long size = 1;
+	int largest = 1;
+	for( int value : values )
+		largest = std::max( largest, value );
+
+	for( int value : values )
+	{
+		size = size / GreatestCommonDivisor( size, value ) * value;
+		if( size > limit )
+			return largest;
+	}
+	return (int)size;
+}
+
+/*=================================================================================================
+  CONSTRUCTORS
+=================================================================================================*/
+
+MaterialArray::MaterialArray()
+{
+	ID = 0;
+	Width = 0;
+	Height = 0;
+	Layers = 0;
+}
+
+/*=================================================================================================
+  CREATE
+=================================================================================================*/
+
+bool MaterialArray::Create( const std::vector<std::string>& paths, int maxSize, const AssetArchive* archive )
+{
+	Delete();
+
+	struct Image
+	{
+		const unsigned char* pixels;
+		int width;
+		int height;
+		bool decoded;	// owned by stb_image rather than the archive
+	};
+
+	std::vector<Image> images;
+	std::vector<int> widths, heights;
+	bool loaded = true;
+	for( const std::string& path : paths )
+	{
+		Image image = {};
+
+		// The top mip level of a cooked texture is the image itself
+		size_t size;
+		AssetTextureHeader header;
+		const unsigned char* cooked = archive != nullptr ? archive->Find( path, ASSET_TEXTURE, size ) : nullptr;
+		if( cooked != nullptr && size >= sizeof( header ) )
+		{
+			memcpy( &header, cooked, sizeof( header ) );
+			if( size - sizeof( header ) >= (size_t)header.width * header.height * 4 )
+			{
+				image.pixels = cooked + sizeof( header );
+				image.width = (int)header.width;
+				image.height = (int)header.height;
+			}
+		}
+
+		int channels;
+		if( image.pixels == NULL )
+		{
+			image.pixels = stbi_load( path.c_str(), &image.width, &image.height, &channels, STBI_rgb_alpha );
+			image.decoded = true;
+		}
+		if( image.pixels == NULL )
+		{
+			std::cerr << "Material failed to load at path: " << path << std::endl;
+			loaded = false;
+			break;
+		}
+
+		images.push_back( image );
+		widths.push_back( image.width );
+		heights.push_back( image.height );
+	}
+
+	if( loaded && !images.empty() )
+	{
+		Width = CommonSize( widths, maxSize );
+		Height = CommonSize( heights, maxSize );
+		Layers = (int)images.size();
+
+		glGenTextures( 1, &ID );
+		glBindTexture( GL_TEXTURE_2D_ARRAY, ID );
+		glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT );
+		glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT );
+		glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR );
+		glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+		glTexImage3D( GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, Width, Height, Layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+
+		std::vector<unsigned char> layer( (size_t)Width * Height * 4 );
+		for( int l = 0; l < Layers; l++ )
+		{
+			const Image& image = images[l];
+			for( int y = 0; y < Height; y++ )
+			{
+				const unsigned char* row = image.pixels + (size_t)( y * image.height / Height ) * image.width * 4;
+				for( int x = 0; x < Width; x++ )
+					memcpy( &layer[( (size_t)y * Width + x ) * 4], row + (size_t)( x * image.width / Width ) * 4, 4 );
+			}
+			glTexSubImage3D( GL_TEXTURE_2D_ARRAY, 0, 0, 0, l, Width, Height, 1, GL_RGBA, GL_UNSIGNED_BYTE, layer.data() );
+		}
+
+		glGenerateMipmap( GL_TEXTURE_2D_ARRAY );
+		glBindTexture( GL_TEXTURE_2D_ARRAY, 0 );
+	}
+
+	for( Image& image : images )
+	{
+		if( image.decoded )
+			stbi_image_free( (void*)image.pixels );
+	}
+
+	return ID != 0;
+}
+
+/*=================================================================================================
+  DELETE
+=================================================================================================*/
+
+void MaterialArray::Delete( void )
+{
+	if( ID != 0 )
+		glDeleteTextures( 1, &ID );
+
+	ID = 0;
+	Width = 0;
+	Height = 0;
+	Layers = 0;
+}
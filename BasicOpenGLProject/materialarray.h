@@ -0,0 +1,38 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+#include "assetarchive.h"
+
+// Several material images packed as the layers of one GL_TEXTURE_2D_ARRAY with a full mip chain,
+// so everything drawn with them shares a single texture binding and selects a layer by index.
+class MaterialArray
+{
+public:
+	MaterialArray();
+
+public:
+	/**
+	Loads the images into layers 0..n-1, in order. Images of different sizes are enlarged with nearest
+	sampling to the smallest size that every image divides evenly, so magnified texels keep their
+	pixel-art look. Magnification stays nearest; minification blends between nearest-sampled mips.
+	*@param paths Image files, one per layer.
+	*@param maxSize Largest layer edge; above it the layers use the largest image size instead.
+	*@param archive Images found here are used in place instead of being decoded.
+	*@return True if every image loaded.
+	**/
+	bool Create( const std::vector<std::string>& paths, int maxSize = 1024, const AssetArchive* archive = nullptr );
+	void Delete();
+
+	GLuint GetID()        const { return ID;     }
+	int    GetNumLayers() const { return Layers; }
+	int    GetWidth()     const { return Width;  }
+	int    GetHeight()    const { return Height; }
+
+private:
+	GLuint ID;
+	int Width;
+	int Height;
+	int Layers;
+};
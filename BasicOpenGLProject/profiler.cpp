@@ -0,0 +1,226 @@
+#include "profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	struct ProfileEvent
+	{
+		const char* name;
+		long long start;
+		long long end;
+		double value;	// counters only
+		bool counter;
+	};
+
+	// Single-producer ring: only the owning thread writes, readers see everything below Count
+	struct ProfileBuffer
+	{
+		static const unsigned int Capacity = 1 << 16;
+
+		std::atomic<unsigned long long> Count;
+		int ThreadID;
+		ProfileEvent Events[Capacity];
+	};
+
+	struct ProfileRegistry
+	{
+		std::mutex Mutex;
+		std::vector<ProfileBuffer*> Buffers;
+		std::string TracePath;
+	};
+
+	const std::chrono::steady_clock::time_point Epoch = std::chrono::steady_clock::now();
+
+	ProfileRegistry& Registry()
+	{
+		static ProfileRegistry registry;
+		return registry;
+	}
+
+	ProfileBuffer* ThreadBuffer()
+	{
+		// Buffers are never freed, so zones closing during shutdown still have somewhere to go
+		thread_local ProfileBuffer* buffer = nullptr;
+		if( buffer == nullptr )
+		{
+			buffer = new ProfileBuffer();
+			buffer->Count.store( 0, std::memory_order_relaxed );
+
+			ProfileRegistry& registry = Registry();
+			std::lock_guard<std::mutex> lock( registry.Mutex );
+			buffer->ThreadID = (int)registry.Buffers.size();
+			registry.Buffers.push_back( buffer );
+		}
+		return buffer;
+	}
+
+	// Copies out the events still held by every thread's ring, and counts the older ones already overwritten
+	std::vector<std::pair<int, ProfileEvent>> Snapshot( unsigned long long* overwritten = nullptr )
+	{
+		if( overwritten != nullptr )
+			*overwritten = 0;
+
+		std::vector<std::pair<int, ProfileEvent>> events;
+
+		ProfileRegistry& registry = Registry();
+		std::lock_guard<std::mutex> lock( registry.Mutex );
+		for( ProfileBuffer* buffer : registry.Buffers )
+		{
+			unsigned long long count = buffer->Count.load( std::memory_order_acquire );
+			unsigned long long first = count > ProfileBuffer::Capacity ? count - ProfileBuffer::Capacity : 0;
+			if( overwritten != nullptr )
+				*overwritten += first;
+			for( unsigned long long i = first; i < count; i++ )
+				events.push_back( std::make_pair( buffer->ThreadID, buffer->Events[i & ( ProfileBuffer::Capacity - 1 )] ) );
+		}
+
+		return events;
+	}
+}
+
+static void PrintPercentiles( std::ostream& out, std::map<std::string, std::vector<double>>& samples, const char* unit );
+
+/*=================================================================================================
+  RECORDING
+=================================================================================================*/
+
+static void Push( const char* name, long long start, long long end, double value, bool counter )
+{
+	ProfileBuffer* buffer = ThreadBuffer();
+
+	unsigned long long index = buffer->Count.load( std::memory_order_relaxed );
+	ProfileEvent& event = buffer->Events[index & ( ProfileBuffer::Capacity - 1 )];
+	event.name = name;
+	event.start = start;
+	event.end = end;
+	event.value = value;
+	event.counter = counter;
+	buffer->Count.store( index + 1, std::memory_order_release );
+}
+
+void Profiler::Record( const char* name, long long start, long long end )
+{
+	Push( name, start, end, 0.0, false );
+}
+
+void Profiler::RecordCounter( const char* name, long long time, double value )
+{
+	Push( name, time, time, value, true );
+}
+
+long long Profiler::Now( void )
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - Epoch ).count();
+}
+
+bool Profiler::IsCompiledIn( void )
+{
+#ifdef ENABLE_PROFILER
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*=================================================================================================
+  OUTPUT
+=================================================================================================*/
+
+void Profiler::WriteOnExit( const std::string& tracePath )
+{
+	// Create the registry before registering the handler, so it is destroyed after the handler runs
+	Registry().TracePath = tracePath;
+	atexit( Finish );
+}
+
+void Profiler::Finish( void )
+{
+	PrintSummary( std::cout );
+	if( WriteChromeTrace( Registry().TracePath ) )
+		std::cout << "Profiler trace written to " << Registry().TracePath << std::endl;
+}
+
+bool Profiler::WriteChromeTrace( const std::string& path )
+{
+	std::ofstream file( path );
+	if( !file )
+	{
+		std::cerr << "Could not write profiler trace: " << path << std::endl;
+		return false;
+	}
+
+	std::vector<std::pair<int, ProfileEvent>> events = Snapshot();
+
+	// Complete ("X") events for zones, counter ("C") events for counters; timestamps are in microseconds.
+	// Fixed notation keeps nanosecond resolution however long the run; the default would switch to exponents.
+	file << std::fixed << std::setprecision( 3 );
+	file << "{\"traceEvents\":[";
+	for( size_t i = 0; i < events.size(); i++ )
+	{
+		const ProfileEvent& event = events[i].second;
+		file << ( i == 0 ? "\n" : ",\n" ) << "{\"name\":\"" << event.name << "\",\"pid\":1,\"tid\":" << events[i].first << ",\"ts\":" << event.start / 1000.0;
+		if( event.counter )
+			file << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}}";
+		else
+			file << ",\"ph\":\"X\",\"dur\":" << ( event.end - event.start ) / 1000.0 << "}";
+	}
+	file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+	return true;
+}
+
+void Profiler::PrintSummary( std::ostream& out )
+{
+	unsigned long long overwritten;
+	std::vector<std::pair<int, ProfileEvent>> events = Snapshot( &overwritten );
+
+	std::map<std::string, std::vector<double>> zones;
+	std::map<std::string, std::vector<double>> counters;
+	for( const std::pair<int, ProfileEvent>& event : events )
+	{
+		if( event.second.counter )
+			counters[event.second.name].push_back( event.second.value );
+		else
+			zones[event.second.name].push_back( ( event.second.end - event.second.start ) / 1000.0 );
+	}
+
+	// The rings only keep the newest events; say so rather than pass a window off as the whole run
+	if( overwritten > 0 )
+		out << "Profiler summary covers the last " << ProfileBuffer::Capacity << " events per thread; "
+			<< overwritten << " older events were overwritten\n";
+	out << "Profiler zones (us):\n";
+	PrintPercentiles( out, zones, "calls" );
+	if( !counters.empty() )
+	{
+		out << "Profiler counters:\n";
+		PrintPercentiles( out, counters, "samples" );
+	}
+	out << std::flush;
+}
+
+static void PrintPercentiles( std::ostream& out, std::map<std::string, std::vector<double>>& samples, const char* unit )
+{
+	for( auto& zone : samples )
+	{
+		std::vector<double>& times = zone.second;
+		std::sort( times.begin(), times.end() );
+
+		double total = 0.0;
+		for( double t : times )
+			total += t;
+
+		size_t n = times.size();
+		out << "  " << zone.first << ": " << n << " " << unit << ", mean " << total / n
+			<< ", p50 " << times[n / 2] << ", p95 " << times[std::min( n - 1, n * 95 / 100 )]
+			<< ", p99 " << times[std::min( n - 1, n * 99 / 100 )] << ", max " << times.back() << "\n";
+	}
+}
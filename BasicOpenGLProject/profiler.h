@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <ostream>
+
+// Zones are only compiled in when ENABLE_PROFILER is defined (the project defines it in Debug
+// builds only); otherwise the macros expand to nothing.
+#ifdef ENABLE_PROFILER
+#define PROFILE_CONCAT_INNER( a, b ) a##b
+#define PROFILE_CONCAT( a, b ) PROFILE_CONCAT_INNER( a, b )
+#define PROFILE_ZONE( name ) ProfileZone PROFILE_CONCAT( profileZone, __LINE__ )( name )
+#else
+#define PROFILE_ZONE( name )
+#endif
+
+class Profiler
+{
+public:
+	/**
+	Records a finished zone into the calling thread's ring buffer. Lock-free; the first call on a
+	thread registers its buffer.
+	*@param name Zone name; must outlive the profiler (a string literal).
+	*@param start Start time from Now().
+	*@param end End time from Now().
+	**/
+	static void Record( const char* name, long long start, long long end );
+
+	/**
+	Records a sampled value (for example a GPU pass time) on the calling thread's timeline.
+	*@param name Counter name; must outlive the profiler (a string literal).
+	*@param time Sample time from Now().
+	*@param value Sample value, summarized and exported as is.
+	**/
+	static void RecordCounter( const char* name, long long time, double value );
+
+	// Nanoseconds since the profiler was loaded
+	static long long Now();
+
+	/**
+	Writes the trace and a summary when the program exits.
+	*@param tracePath Output file for the Chrome trace JSON.
+	**/
+	static void WriteOnExit( const std::string& tracePath );
+
+	/**
+	Writes every buffered zone as Chrome trace events (chrome://tracing, about:tracing).
+	*@param path Output file.
+	*@return True if the file was written.
+	**/
+	static bool WriteChromeTrace( const std::string& path );
+
+	// Prints count, mean, p50, p95, p99 and max per zone and per counter, over the events still in the
+	// per-thread rings (the last 65536 per thread); notes how many older events were overwritten
+	static void PrintSummary( std::ostream& out );
+
+	static bool IsCompiledIn();
+
+private:
+	static void Finish();
+};
+
+class ProfileZone
+{
+public:
+	explicit ProfileZone( const char* name ) : Name( name ), Start( Profiler::Now() ) {}
+	~ProfileZone() { Profiler::Record( Name, Start, Profiler::Now() ); }
+
+	ProfileZone( const ProfileZone& ) = delete;
+	ProfileZone& operator=( const ProfileZone& ) = delete;
+
+private:
+	const char* Name;
+	long long Start;
+};
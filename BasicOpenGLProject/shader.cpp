@@ -1,6 +1,10 @@
 #include "shader.h"
+#include "assetarchive.h"
 #include <iostream>
 #include <fstream>
+#include <iterator>
+
+const AssetArchive* Shader::Archive = nullptr;
 
 /*=================================================================================================
   CONSTRUCTORS
@@ -13,9 +17,9 @@ Shader::Shader()
 	Path = "";
 }
 
-Shader::Shader( std::string shaderPath, GLenum shaderType )
+Shader::Shader( std::string shaderPath, GLenum shaderType, std::string shaderDefines )
 {
-	Create( shaderPath, shaderType );
+	Create( shaderPath, shaderType, shaderDefines );
 }
 
 /*=================================================================================================
@@ -31,12 +35,13 @@ Shader::~Shader()
   CREATE
 =================================================================================================*/
 
-void Shader::Create( std::string shaderPath, GLenum shaderType )
+void Shader::Create( std::string shaderPath, GLenum shaderType, std::string shaderDefines )
 {
 	ID = glCreateShader( shaderType );
 
 	Type = shaderType;
 	Path = shaderPath;
+	Defines = shaderDefines;
 
 	Load();
 }
@@ -52,6 +57,7 @@ void Shader::Delete( void )
 	ID = 0;
 	Type = GL_INVALID_ENUM;
 	Path = "";
+	Defines = "";
 }
 
 /*=================================================================================================
@@ -63,18 +69,9 @@ void Shader::Load( void )
 	if( ID == 0 )
 		return;
 
-	std::ifstream srcFile( Path );
-	std::string shaderSrc, line;
-
-	if( srcFile.is_open() == true )
+	std::string shaderSrc;
+	if( ReadSource( Path, Defines, shaderSrc ) == true )
 	{
-		while( std::getline( srcFile, line ) )
-		{
-			shaderSrc += line;
-			shaderSrc += '\n';
-		}
-		srcFile.close();
-
 		const char* src = shaderSrc.c_str();
 
 		glShaderSource( ID, 1, &src, NULL );
@@ -89,6 +86,41 @@ void Shader::Load( void )
 		std::cerr << "Unable to open shader file: " << Path << std::endl;
 }
 
+bool Shader::ReadSource( const std::string& path, const std::string& defines, std::string& source )
+{
+	size_t size;
+	const unsigned char* cooked = Archive != nullptr ? Archive->Find( path, ASSET_SHADER, size ) : nullptr;
+	if( cooked != nullptr )
+		source.assign( (const char*)cooked, size );
+	else
+	{
+		std::ifstream srcFile( path, std::ios::binary );
+		if( srcFile.is_open() == false )
+			return false;
+
+		// Read the whole file at once rather than line by line
+		source.assign( std::istreambuf_iterator<char>( srcFile ), std::istreambuf_iterator<char>() );
+	}
+
+	// Defines have to follow the #version directive
+	if( defines.empty() == false )
+	{
+		size_t version = source.compare( 0, 8, "#version" ) == 0 ? 0 : source.find( "\n#version" );
+		if( version == std::string::npos )
+			return true;
+
+		size_t lineEnd = source.find( '\n', version == 0 ? 0 : version + 1 );
+		if( lineEnd == std::string::npos )
+		{
+			source += '\n';
+			lineEnd = source.size() - 1;
+		}
+		source.insert( lineEnd + 1, defines );
+	}
+
+	return true;
+}
+
 /*=================================================================================================
   GET STATUS
 =================================================================================================*/
@@ -4,18 +4,32 @@
 #include <GL/freeglut.h>
 #include <string>
 
+class AssetArchive;
+
 class Shader
 {
 public:
 	Shader();
-	Shader( std::string shaderPath, GLenum shaderType );
+	Shader( std::string shaderPath, GLenum shaderType, std::string shaderDefines = "" );
 	~Shader();
 
 public:
-	void Create( std::string shaderPath, GLenum shaderType );
+	void Create( std::string shaderPath, GLenum shaderType, std::string shaderDefines = "" );
 	void Delete();
 	void Load();
 
+	/**
+	Reads a shader file and inserts the defines after its #version directive, as Load compiles it.
+	*@param path Path of the shader file.
+	*@param defines Preprocessor lines to insert.
+	*@param source Receives the source.
+	*@return False if the file could not be opened.
+	**/
+	static bool ReadSource( const std::string& path, const std::string& defines, std::string& source );
+
+	// Reads sources from the archive first and from disk for shaders missing in it or edited since; nullptr reads from disk
+	static void SetArchive( const AssetArchive* archive ) { Archive = archive; }
+
 public:
 	int GetStatus( GLenum ) const;
 	int GetDeleteStatus() const;
@@ -27,9 +41,14 @@ public:
 	GLuint      GetID()   const { return ID;   }
 	GLenum      GetType() const { return Type; }
 	std::string GetPath() const { return Path; }
+	std::string GetDefines() const { return Defines; }
 
 private:
 	GLuint ID;
 	GLenum Type;
 	std::string Path;
+	std::string Defines; // "#define ..." lines inserted after the #version directive
+
+	static const AssetArchive* Archive;
+
 };
@@ -0,0 +1,65 @@
+#include "shaderpermutations.h"
+#include <iostream>
+
+/*=================================================================================================
+  CONSTRUCTORS
+=================================================================================================*/
+
+ShaderPermutations::ShaderPermutations()
+{
+	VertexPath = "";
+	FragmentPath = "";
+	BaseDefines = "";
+}
+
+/*=================================================================================================
+  CREATE
+=================================================================================================*/
+
+void ShaderPermutations::Create( std::string vspath, std::string fspath, std::vector<std::string> featureNames, std::string baseDefines )
+{
+	Delete();
+
+	VertexPath = vspath;
+	FragmentPath = fspath;
+	FeatureNames = featureNames;
+	BaseDefines = baseDefines;
+}
+
+/*=================================================================================================
+  DELETE
+=================================================================================================*/
+
+void ShaderPermutations::Delete( void )
+{
+	Variants.clear();
+}
+
+/*=================================================================================================
+  GET
+=================================================================================================*/
+
+ShaderProgram& ShaderPermutations::Get( unsigned int features )
+{
+	auto found = Variants.find( features );
+	if( found != Variants.end() )
+		return found->second;
+
+	ShaderProgram& program = Variants[features];
+	program.SetDefines( GetDefines( features ) );
+	program.Create( VertexPath, FragmentPath );
+
+	std::cout << "Compiled " << VertexPath << " variant " << features << " (" << Variants.size() << " cached)" << std::endl;
+	return program;
+}
+
+std::string ShaderPermutations::GetDefines( unsigned int features ) const
+{
+	std::string defines = BaseDefines;
+	for( size_t i = 0; i < FeatureNames.size(); i++ )
+	{
+		if( features & ( 1u << i ) )
+			defines += "#define " + FeatureNames[i] + "\n";
+	}
+	return defines;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include "shaderprogram.h"
+
+// Variants of one vertex/fragment pair, each compiled with a different set of #defines.
+// Bit i of a feature key turns on the i-th feature name; variants are compiled on first use and cached by key.
+class ShaderPermutations
+{
+public:
+	ShaderPermutations();
+
+public:
+	/**
+	Sets the sources of the variants. Nothing is compiled until Get is called.
+	*@param vspath Vertex shader path.
+	*@param fspath Fragment shader path.
+	*@param featureNames Name of the #define emitted for each feature bit.
+	*@param baseDefines Preprocessor lines shared by every variant.
+	**/
+	void Create( std::string vspath, std::string fspath, std::vector<std::string> featureNames, std::string baseDefines = "" );
+	void Delete();
+
+	/**
+	Returns the variant for a feature key, compiling and linking it the first time it is requested.
+	*@param features Bitmask of feature indices.
+	**/
+	ShaderProgram& Get( unsigned int features );
+
+	std::string GetDefines( unsigned int features ) const;
+
+private:
+	std::string VertexPath;
+	std::string FragmentPath;
+	std::string BaseDefines;
+	std::vector<std::string> FeatureNames;
+
+	// std::map never moves its nodes, so references returned by Get stay valid
+	std::map<unsigned int, ShaderProgram> Variants;
+};
@@ -1,5 +1,31 @@
 #include "shaderprogram.h"
+#include "cookedfile.h"
+#include "mappedfile.h"
 #include <iostream>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+// Prefixed to every cached program binary
+struct ProgramBinaryHeader
+{
+	char magic[4];
+	unsigned int version;
+	GLenum format;
+	float compileMs;
+	unsigned long long key;	// driver and sources the binary was linked from
+};
+
+static const char ProgramBinaryMagic[4] = { 'P', 'B', 'I', 'N' };
+static const unsigned int ProgramBinaryVersion = 2;
+
+std::string ShaderProgram::BinaryCachePrefix = "";
+unsigned int ShaderProgram::BinaryCacheHits = 0;
+unsigned int ShaderProgram::BinaryCacheMisses = 0;
+double ShaderProgram::BinaryCacheSavedMs = 0.0;
 
 /*=================================================================================================
   CONSTRUCTORS
@@ -40,52 +66,87 @@ ShaderProgram::~ShaderProgram()
 
 void ShaderProgram::Create( std::string cspath )
 {
-	ID = glCreateProgram();
+	Stages = { { GL_COMPUTE_SHADER, cspath } };
+	Build();
+}
 
-	if( ID != 0 )
-	{
-		computeShader.Create( cspath, GL_COMPUTE_SHADER );
-		glAttachShader( ID, computeShader.GetID() );
+void ShaderProgram::Create( std::string vspath, std::string fspath )
+{
+	Stages = { { GL_VERTEX_SHADER, vspath }, { GL_FRAGMENT_SHADER, fspath } };
+	Build();
+}
 
-		Link();
-	}
+void ShaderProgram::Create( std::string vspath, std::string gspath, std::string fspath )
+{
+	Stages = { { GL_VERTEX_SHADER, vspath }, { GL_GEOMETRY_SHADER, gspath }, { GL_FRAGMENT_SHADER, fspath } };
+	Build();
 }
 
-void ShaderProgram::Create( std::string vspath, std::string fspath )
+void ShaderProgram::Build( void )
 {
 	ID = glCreateProgram();
 
-	if( ID != 0 )
+	if( ID == 0 )
+		return;
+
+	auto start = std::chrono::steady_clock::now();
+	unsigned long long binaryKey = 0;
+	std::string binaryPath = GetBinaryPath( binaryKey );
+	float compileMs = 0.0f;
+
+	if( binaryPath.empty() == false && LoadBinary( binaryPath, binaryKey, compileMs ) == true )
 	{
-		vertexShader.Create( vspath, GL_VERTEX_SHADER );
-		glAttachShader( ID, vertexShader.GetID() );
+		double loadMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+		BinaryCacheHits++;
+		BinaryCacheSavedMs += std::max( 0.0, compileMs - loadMs );
 
-		fragmentShader.Create( fspath, GL_FRAGMENT_SHADER );
-		glAttachShader( ID, fragmentShader.GetID() );
+		std::cout << "Program binary cache hit: " << GetStageNames() << " loaded in " << loadMs << " ms (compiling took " << compileMs << " ms)" << std::endl;
+		CacheUniformLocations();
+		return;
+	}
 
-		Link();
+	for( const Stage& stage : Stages )
+	{
+		Shader& shader = GetShader( stage.type );
+		shader.Delete();
+		shader.Create( stage.path, stage.type, Defines );
+		glAttachShader( ID, shader.GetID() );
 	}
-}
 
-void ShaderProgram::Create( std::string vspath, std::string gspath, std::string fspath )
-{
-	ID = glCreateProgram();
+	if( binaryPath.empty() == false )
+		glProgramParameteri( ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
 
-	if( ID != 0 )
-	{
-		vertexShader.Create( vspath, GL_VERTEX_SHADER );
-		glAttachShader( ID, vertexShader.GetID() );
+	Link();
+
+	if( binaryPath.empty() == true )
+		return;
 
-		geometryShader.Create( gspath, GL_GEOMETRY_SHADER );
-		glAttachShader( ID, geometryShader.GetID() );
+	double linkMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+	BinaryCacheMisses++;
+	std::cout << "Program binary cache miss: " << GetStageNames() << " compiled in " << linkMs << " ms" << std::endl;
 
-		fragmentShader.Create( fspath, GL_FRAGMENT_SHADER );
-		glAttachShader( ID, fragmentShader.GetID() );
+	if( GetLinkStatus() == 1 )
+		SaveBinary( binaryPath, binaryKey, (float)linkMs );
+}
 
-		Link();
+Shader& ShaderProgram::GetShader( GLenum type )
+{
+	switch( type ) {
+		case GL_GEOMETRY_SHADER: return geometryShader;
+		case GL_FRAGMENT_SHADER: return fragmentShader;
+		case GL_COMPUTE_SHADER:  return computeShader;
+		default:                 return vertexShader;
 	}
 }
 
+std::string ShaderProgram::GetStageNames( void ) const
+{
+	std::string names;
+	for( const Stage& stage : Stages )
+		names += ( names.empty() ? "" : " + " ) + stage.path;
+	return names;
+}
+
 /*=================================================================================================
   DELETE
 =================================================================================================*/
@@ -103,6 +164,8 @@ void ShaderProgram::Delete( void )
 
 		ID = 0;
 	}
+
+	UniformLocations.clear();
 }
 
 /*=================================================================================================
@@ -116,6 +179,8 @@ void ShaderProgram::Link( void )
 	// If the program didn't link successfully, print log
 	if( GetLinkStatus() == 0 )
 		std::cerr << "shader program " << ID << " link log" << std::endl << GetInfoLog() << std::endl;
+
+	CacheUniformLocations();
 }
 
 /*=================================================================================================
@@ -137,11 +202,125 @@ void ShaderProgram::Validate( void )
 
 void ShaderProgram::Reload( void )
 {
-	vertexShader.Load();
-	geometryShader.Load();
-	fragmentShader.Load();
-	computeShader.Load();
-	Link();
+	// A program restored from a binary has no compiled shaders to reload, so rebuild it from its files;
+	// edited sources hash to a new cache entry
+	Delete();
+	Build();
+}
+
+/*=================================================================================================
+  BINARY CACHE
+=================================================================================================*/
+
+void ShaderProgram::SetBinaryCache( std::string prefix )
+{
+	BinaryCachePrefix = prefix;
+}
+
+void ShaderProgram::PrintBinaryCacheStats( std::ostream& out )
+{
+	out << "Program binary cache: " << BinaryCacheHits << " hits, " << BinaryCacheMisses << " misses, "
+		<< BinaryCacheSavedMs << " ms of compiling saved" << std::endl;
+}
+
+std::string ShaderProgram::GetBinaryPath( unsigned long long& key ) const
+{
+	if( BinaryCachePrefix.empty() == true || !( GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary ) )
+		return "";
+
+	GLint numFormats = 0;
+	glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats );
+	if( numFormats == 0 )
+		return "";
+
+	// The file is named after the stage paths and defines, so each program or variant keeps one file that
+	// is overwritten when it changes. Binaries only load on the driver that produced them, so the key
+	// checked against the header covers the driver strings as well as the stage sources.
+	unsigned long long id = HashBytes( Defines.data(), Defines.size() );
+	key = HashBytes( nullptr, 0 );
+	const GLenum driverStrings[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	for( GLenum name : driverStrings )
+	{
+		const char* value = (const char*)glGetString( name );
+		if( value != nullptr )
+			key = HashBytes( value, strlen( value ), key );
+	}
+
+	for( const Stage& stage : Stages )
+	{
+		std::string source;
+		if( Shader::ReadSource( stage.path, Defines, source ) == false )
+			return "";
+
+		id = HashBytes( &stage.type, sizeof( stage.type ), id );
+		id = HashBytes( stage.path.data(), stage.path.size(), id );
+		key = HashBytes( &stage.type, sizeof( stage.type ), key );
+		key = HashBytes( source.data(), source.size(), key );
+	}
+
+	// Readable prefix from the first stage, e.g. "texpersplight-"
+	std::string stem = Stages.front().path;
+	stem = stem.substr( stem.find_last_of( "/\\" ) + 1 );
+	stem = stem.substr( 0, stem.find_last_of( '.' ) );
+
+	char name[17];
+	snprintf( name, sizeof( name ), "%016llx", id );
+	return BinaryCachePrefix + stem + "-" + name + ".progbin";
+}
+
+bool ShaderProgram::LoadBinary( const std::string& path, unsigned long long key, float& compileMs )
+{
+	MappedFile file;
+	ProgramBinaryHeader header;
+	if( file.Open( path ) == false || file.GetSize() <= sizeof( header ) )
+		return false;
+
+	memcpy( &header, file.GetData(), sizeof( header ) );
+	if( memcmp( header.magic, ProgramBinaryMagic, sizeof( header.magic ) ) != 0 || header.version != ProgramBinaryVersion )
+		return false;
+
+	// Sources or driver changed since the binary was saved; the caller compiles and overwrites it
+	if( header.key != key )
+		return false;
+
+	glProgramBinary( ID, header.format, file.GetData() + sizeof( header ), (GLsizei)( file.GetSize() - sizeof( header ) ) );
+
+	// A driver update can reject an old binary; the caller then compiles from source and replaces it
+	if( GetLinkStatus() != 1 )
+	{
+		std::cerr << "Program binary rejected, recompiling: " << path << std::endl;
+		return false;
+	}
+
+	compileMs = header.compileMs;
+	return true;
+}
+
+void ShaderProgram::SaveBinary( const std::string& path, unsigned long long key, float compileMs ) const
+{
+	GLint length = 0;
+	glGetProgramiv( ID, GL_PROGRAM_BINARY_LENGTH, &length );
+	if( length <= 0 )
+		return;
+
+	ProgramBinaryHeader header;
+	memcpy( header.magic, ProgramBinaryMagic, sizeof( header.magic ) );
+	header.version = ProgramBinaryVersion;
+	header.format = 0;
+	header.compileMs = compileMs;
+	header.key = key;
+
+	std::vector<char> binary( length );
+	GLsizei written = 0;
+	glGetProgramBinary( ID, length, &written, &header.format, binary.data() );
+	if( written <= 0 )
+		return;
+
+	std::ofstream file( path, std::ios::binary | std::ios::trunc );
+	file.write( (const char*)&header, sizeof( header ) );
+	file.write( binary.data(), written );
+	if( !file )
+		std::cerr << "Unable to write program binary: " << path << std::endl;
 }
 
 /*=================================================================================================
@@ -250,6 +429,64 @@ std::string ShaderProgram::GetInfoLog( void ) const
 	return stringLog;
 }
 
+/*=================================================================================================
+  UNIFORM LOCATIONS
+=================================================================================================*/
+
+void ShaderProgram::CacheUniformLocations( void )
+{
+	UniformLocations.clear();
+
+	if( GetLinkStatus() != 1 )
+		return;
+
+	GLint numUniforms = GetNumActiveUniforms();
+	GLint maxLength = GetActiveUniformMaxLength();
+	std::string name( maxLength > 0 ? maxLength : 1, '\0' );
+
+	for( GLint i = 0; i < numUniforms; i++ )
+	{
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = GL_NONE;
+		glGetActiveUniform( ID, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, &name[0] );
+
+		std::string uniformName( name.c_str(), length );
+		GLint location = glGetUniformLocation( ID, uniformName.c_str() );
+		UniformLocations[uniformName] = location;
+
+		// Arrays are reported once as "name[0]"; register the bare name and every element
+		std::string::size_type bracket = uniformName.find( '[' );
+		if( bracket != std::string::npos && location != -1 )
+		{
+			std::string baseName = uniformName.substr( 0, bracket );
+			UniformLocations[baseName] = location;
+
+			for( GLint e = 1; e < size; e++ )
+			{
+				std::string elementName = baseName + "[" + std::to_string( e ) + "]";
+				UniformLocations[elementName] = glGetUniformLocation( ID, elementName.c_str() );
+			}
+		}
+	}
+}
+
+GLint ShaderProgram::getUniformLocation( const GLchar* name ) const
+{
+	auto it = UniformLocations.find( name );
+	if( it != UniformLocations.end() )
+	{
+		UniformCacheHits++;
+		return it->second;
+	}
+
+	// Not an active uniform (or the program is not linked); remember the answer so we only ask once
+	UniformCacheMisses++;
+	GLint location = glGetUniformLocation( ID, name );
+	UniformLocations.emplace( name, location );
+	return location;
+}
+
 /*=================================================================================================
   UNIFORM SETTERS
 =================================================================================================*/
@@ -424,3 +661,24 @@ void ShaderProgram::SetUniform( const GLchar* name, const GLfloat* m, GLuint dim
 	GLint location = getUniformLocation( name );
 	SetUniform( location, m, dim, transpose, count );
 }
+
+//Setting non-square uniform matrix value:
+//Location:
+void ShaderProgram::SetUniform( GLint location, const GLfloat* m, GLuint columns, GLuint rows, GLboolean transpose, GLsizei count ) {
+	switch( columns * 10 + rows ) {
+		case 22: glUniformMatrix2fv( location, count, transpose, m ); break;
+		case 23: glUniformMatrix2x3fv( location, count, transpose, m ); break;
+		case 24: glUniformMatrix2x4fv( location, count, transpose, m ); break;
+		case 32: glUniformMatrix3x2fv( location, count, transpose, m ); break;
+		case 33: glUniformMatrix3fv( location, count, transpose, m ); break;
+		case 34: glUniformMatrix3x4fv( location, count, transpose, m ); break;
+		case 42: glUniformMatrix4x2fv( location, count, transpose, m ); break;
+		case 43: glUniformMatrix4x3fv( location, count, transpose, m ); break;
+		case 44: glUniformMatrix4fv( location, count, transpose, m ); break;
+	}
+}
+//Name:
+void ShaderProgram::SetUniform( const GLchar* name, const GLfloat* m, GLuint columns, GLuint rows, GLboolean transpose, GLsizei count ) {
+	GLint location = getUniformLocation( name );
+	SetUniform( location, m, columns, rows, transpose, count );
+}
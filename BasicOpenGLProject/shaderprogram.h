@@ -3,6 +3,9 @@
 #include <GL/glew.h>
 #include <GL/freeglut.h>
 #include <string>
+#include <map>
+#include <vector>
+#include <ostream>
 #include "shader.h"
 
 class ShaderProgram
@@ -24,6 +27,20 @@ public:
 	void Reload();
 	void Use();
 
+	// Preprocessor lines (e.g. "#define FOO\n") compiled into every stage; call before Create
+	void SetDefines( std::string defines ) { Defines = defines; }
+	std::string GetDefines() const { return Defines; }
+
+	/**
+	Enables the program binary cache for programs created afterwards. Each program or variant is saved
+	as <prefix><first stage>-<hash of stage paths and defines>.progbin with a key of the driver strings
+	and the stage sources in its header, and loaded with glProgramBinary instead of compiling when the
+	key matches. A mismatch recompiles and overwrites the same file.
+	*@param prefix Directory (with trailing slash) and file name prefix; empty disables the cache.
+	**/
+	static void SetBinaryCache( std::string prefix );
+	static void PrintBinaryCacheStats( std::ostream& out );
+
 public:
 	int GetStatus( GLenum ) const;
 	int GetDeleteStatus() const;
@@ -42,10 +59,17 @@ public:
 	GLuint GetID() { return ID; }
 
 public:
-	GLint getUniformLocation( const GLchar* name ) const
-	{
-		return glGetUniformLocation( ID, name );
-	}
+	/**
+	Returns the location of a uniform variable. Locations are cached when the program is linked,
+	so this normally does not call into the driver. Names missing from the cache are looked up
+	with glGetUniformLocation once and then cached as well.
+	*@param name Name of uniform variable.
+	**/
+	GLint getUniformLocation( const GLchar* name ) const;
+
+	unsigned int GetUniformCacheHits()   const { return UniformCacheHits;   }
+	unsigned int GetUniformCacheMisses() const { return UniformCacheMisses; }
+	void ResetUniformCacheStats() { UniformCacheHits = UniformCacheMisses = 0; }
 
 	//@{
 	/**
@@ -123,7 +147,50 @@ public:
 	void SetUniform( GLint location, const GLfloat* m, GLuint dim, GLboolean transpose = GL_FALSE, GLsizei count = 1 );
 	//@}
 
+	//@{
+	/**
+	Sets a non-square uniform matrix value by {name|location}.
+	*@param name  Name of uniform variable.
+	*@param location  Location handle of uniform variable.
+	*@param m  Matrix value with columns*rows values
+	*@param columns  Number of columns of the matrix m.
+	*@param rows  Number of rows of the matrix m.
+	*@param transpose If transpose is GL_FALSE, each matrix is assumed to be supplied in
+	*					in column major order, otherwise is in row major order.
+	*@param count  Number of elements of the uniform matrix array to be modified.
+	**/
+	void SetUniform( const GLchar* name, const GLfloat* m, GLuint columns, GLuint rows, GLboolean transpose, GLsizei count );
+	void SetUniform( GLint location, const GLfloat* m, GLuint columns, GLuint rows, GLboolean transpose, GLsizei count );
+	//@}
+
+private:
+	struct Stage {
+		GLenum type;
+		std::string path;
+	};
+
+	void Build();
+	void CacheUniformLocations();
+	Shader& GetShader( GLenum type );
+	std::string GetStageNames() const;
+
+	std::string GetBinaryPath( unsigned long long& key ) const;
+	bool LoadBinary( const std::string& path, unsigned long long key, float& compileMs );
+	void SaveBinary( const std::string& path, unsigned long long key, float compileMs ) const;
+
 private:
 	GLuint ID;
 	Shader vertexShader, geometryShader, fragmentShader, computeShader;
+	std::string Defines;
+	std::vector<Stage> Stages;
+
+	static std::string BinaryCachePrefix;
+	static unsigned int BinaryCacheHits;
+	static unsigned int BinaryCacheMisses;
+	static double BinaryCacheSavedMs;
+
+	// Uniform name -> location, filled in Link(). std::less<> allows lookups by const GLchar* without building a std::string
+	mutable std::map<std::string, GLint, std::less<>> UniformLocations;
+	mutable unsigned int UniformCacheHits = 0;
+	mutable unsigned int UniformCacheMisses = 0;
 };
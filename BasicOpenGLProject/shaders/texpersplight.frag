@@ -6,44 +6,48 @@ in vec2 vert_TexCoord;
 
 out vec4 frag_Color;
 
+// TEXTURE_ARRAY: the texture is one layer of a material array, chosen per vertex or per instance
+#ifdef TEXTURE_ARRAY
+flat in int vert_Layer;
+uniform sampler2DArray texArray;
+#else
 uniform sampler2D texId;
+#endif
 
-uniform mat4 viewMatrix;
-uniform mat4 modelMatrix;
+// Per-draw constants set by SetLighting; positions and normals arrive in view space
+uniform vec3 lightPosition;
+uniform vec4 lightAmbient;
+uniform vec4 lightDiffuse;
+uniform vec4 lightSpecular;
+uniform vec4 materialSpecular;
+uniform float materialShininess;
 
+// LIT: Phong shading with one point light; without it the texture color is output unchanged
 vec4 shade( vec4 color )
 {
-	vec4 la = vec4( 0.7, 0.7, 0.7, 1.0 );
-	vec4 ld = vec4( 0.7, 0.7, 0.7, 1.0 );
-	vec4 ls = vec4( 1.0, 1.0, 1.0, 1.0 );
+	vec3 N = normalize( vert_Normal.xyz ); // vertex normal
+	vec3 L = normalize( lightPosition - vert_Pos.xyz ); // light direction
+	vec3 R = reflect( -L, N ); // reflected ray, unit length since L and N are
+	vec3 V = vec3( 0.0, 0.0, 1.0 ); // view direction
 
-	vec4 ka = color;
-	vec4 kd = color;
-	vec4 ks = vec4( 1.0, 1.0, 1.0, 1.0 );
-
-	float shininess = 32.0f;
-
-	mat4 transf = viewMatrix * modelMatrix;
-
-	vec3 FragPos  = vec3( transf * vert_Pos );
-	vec3 FragNorm = mat3( transpose( inverse( transf ) ) ) * vert_Normal.xyz;
-	vec3 LightPos = vec3( transf * vec4( 3.0, 0.0, 3.0, 1.0 ) );
-
-	vec3 N = normalize( FragNorm ); // vertex normal
-	vec3 L = normalize( LightPos - FragPos ); // light direction
-	vec3 R = normalize( reflect( -L, N ) ); // reflected ray
-	vec3 V = normalize( vec3( 0.0, 0.0, 1.0 ) ); // view direction
-
-	float dotLN = dot( L, N );
-	vec4 amb = ka * la;
-	vec4 dif = kd * ld * max( dotLN, 0.0 );
-	vec4 spe = ks * ls * pow( max( dot( V, R ), 0.0 ), shininess ) * max( dotLN, 0.0 );
+	float dotLN = max( dot( L, N ), 0.0 );
+	vec4 amb = color * lightAmbient;
+	vec4 dif = color * lightDiffuse * dotLN;
+	vec4 spe = materialSpecular * lightSpecular * pow( max( dot( V, R ), 0.0 ), materialShininess ) * dotLN;
 
 	return amb + dif + spe;
 }
 
 void main(void)
 {
+#ifdef TEXTURE_ARRAY
+	vec4 color = texture( texArray, vec3( vert_TexCoord, vert_Layer ) );
+#else
 	vec4 color = texture( texId, vert_TexCoord );
+#endif
+#ifdef LIT
 	frag_Color = shade( color );
+#else
+	frag_Color = color;
+#endif
 }
@@ -1,42 +1,103 @@
 #version 400
 
 layout(location=0) in vec3 in_Position;
+#ifdef OCTAHEDRAL_NORMALS
+layout(location=1) in vec2 in_Normal;
+#else
 layout(location=1) in vec3 in_Normal;
+#endif
 layout(location=2) in vec2 in_TexCoord;
-layout(location=3) in ivec4 boneIds;
+#ifdef SKINNED
+layout(location=3) in uvec4 boneIds;
 layout(location=4) in vec4 weights;
+#endif
+
+// TEXTURE_ARRAY: each vertex names its layer of the material array
+#ifdef TEXTURE_ARRAY
+layout(location=5) in float in_Layer;
+flat out int vert_Layer;
+#endif
 
 out vec4 vert_Pos;
 out vec4 vert_Normal;
 out vec2 vert_TexCoord;
 
 uniform mat4 projectionMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 modelMatrix;
+uniform mat4 modelViewMatrix;
+uniform mat3 normalMatrix;
+
+// OCTAHEDRAL_NORMALS: normals arrive as two shorts folded onto the octahedron
+#ifdef OCTAHEDRAL_NORMALS
+vec3 decodeNormal( vec2 encoded )
+{
+	vec2 e = clamp( encoded / 32767.0f, -1.0f, 1.0f );
+	vec3 n = vec3( e, 1.0f - abs( e.x ) - abs( e.y ) );
+	if( n.z < 0.0f )
+		n.xy = ( 1.0f - abs( n.yx ) ) * vec2( n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f );
+	return normalize( n );
+}
+#else
+vec3 decodeNormal( vec3 normal )
+{
+	return normal;
+}
+#endif
 
+// SKINNED: blend up to four bones per vertex; without it the mesh is static and only the MVP transform runs
+#ifdef SKINNED
 const int MAX_BONES = 100;
 const int MAX_BONE_INFLUENCE = 4;
+
+// COMPACT_BONE_PALETTE: each bone is the top three rows of its affine matrix, stored as the columns of a mat3x4
+#ifdef COMPACT_BONE_PALETTE
+uniform mat3x4 finalBonesMatrices[MAX_BONES];
+#else
 uniform mat4 finalBonesMatrices[MAX_BONES];
+#endif
+
+vec4 skin( uint boneId, vec4 position )
+{
+#ifdef COMPACT_BONE_PALETTE
+	return vec4( position * finalBonesMatrices[boneId], 1.0f );
+#else
+	return finalBonesMatrices[boneId] * position;
+#endif
+}
+#endif
 
 void main( void )
 {
+#ifdef SKINNED
 	vec4 totalPosition = vec4(0.0f);
 	for(int i = 0; i < MAX_BONE_INFLUENCE; i++)
 	{
-		if(boneIds[i] == -1)
+		// Unused slots have zero weight in every layout
+		if(weights[i] == 0.0f)
 			continue;
-		if(boneIds[i] >= MAX_BONES)
+		if(boneIds[i] >= uint(MAX_BONES))
 		{
 			totalPosition = vec4(in_Position, 1.0f);
 			break;
 		}
-		vec4 localPosition = finalBonesMatrices[boneIds[i]] * vec4(in_Position, 1.0f);
+		vec4 localPosition = skin(boneIds[i], vec4(in_Position, 1.0f));
 		totalPosition += localPosition * weights[i];
 	}
 
-	gl_Position = projectionMatrix * viewMatrix * modelMatrix * totalPosition;
-	
-	vert_Pos      = totalPosition;
-	vert_Normal   = vec4(in_Normal, 1.0f);
+	// Vertices without bone weights are drawn unskinned
+	if(totalPosition.w == 0.0f)
+		totalPosition = vec4(in_Position, 1.0f);
+#else
+	vec4 totalPosition = vec4(in_Position, 1.0f);
+#endif
+
+	vec4 viewPosition = modelViewMatrix * totalPosition;
+	gl_Position = projectionMatrix * viewPosition;
+
+	// Lighting happens in view space
+	vert_Pos      = viewPosition;
+	vert_Normal   = vec4(normalMatrix * decodeNormal(in_Normal), 0.0f);
 	vert_TexCoord = in_TexCoord;
+#ifdef TEXTURE_ARRAY
+	vert_Layer    = int(in_Layer + 0.5f);
+#endif
 }
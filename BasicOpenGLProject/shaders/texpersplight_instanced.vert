@@ -0,0 +1,54 @@
+#version 400
+
+layout(location=0) in vec3 in_Position;
+#ifdef OCTAHEDRAL_NORMALS
+layout(location=1) in vec2 in_Normal;
+#else
+layout(location=1) in vec3 in_Normal;
+#endif
+layout(location=2) in vec2 in_TexCoord;
+
+// Per-instance box: minimum corner, texture layer and size of the tile
+layout(location=5) in vec4 in_BoxOrigin;
+layout(location=6) in vec3 in_BoxSize;
+
+out vec4 vert_Pos;
+out vec4 vert_Normal;
+out vec2 vert_TexCoord;
+flat out int vert_Layer;
+
+uniform mat4 projectionMatrix;
+uniform mat4 modelViewMatrix;
+uniform mat3 normalMatrix;
+
+// OCTAHEDRAL_NORMALS: normals arrive as two shorts folded onto the octahedron
+#ifdef OCTAHEDRAL_NORMALS
+vec3 decodeNormal( vec2 encoded )
+{
+	vec2 e = clamp( encoded / 32767.0f, -1.0f, 1.0f );
+	vec3 n = vec3( e, 1.0f - abs( e.x ) - abs( e.y ) );
+	if( n.z < 0.0f )
+		n.xy = ( 1.0f - abs( n.yx ) ) * vec2( n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f );
+	return normalize( n );
+}
+#else
+vec3 decodeNormal( vec3 normal )
+{
+	return normal;
+}
+#endif
+
+void main( void )
+{
+	// in_Position is a corner of the unit cube
+	vec4 position = vec4( in_BoxOrigin.xyz + in_Position * in_BoxSize, 1.0f );
+
+	vec4 viewPosition = modelViewMatrix * position;
+	gl_Position = projectionMatrix * viewPosition;
+
+	// Lighting happens in view space
+	vert_Pos      = viewPosition;
+	vert_Normal   = vec4(normalMatrix * decodeNormal(in_Normal), 0.0f);
+	vert_TexCoord = in_TexCoord;
+	vert_Layer    = int(in_BoxOrigin.w);
+}
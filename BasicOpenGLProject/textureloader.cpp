@@ -0,0 +1,281 @@
+#include "textureloader.h"
+#include "mappedfile.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+
+/*=================================================================================================
+  CONSTRUCTORS
+=================================================================================================*/
+
+TextureLoader::TextureLoader()
+{
+	Stopping = false;
+	NextSerial = 0;
+	Pending = 0;
+	PixelBuffers[0] = PixelBuffers[1] = 0;
+	NextPixelBuffer = 0;
+	NumUploaded = 0;
+	DecodeMs = 0.0;
+}
+
+/*=================================================================================================
+  DESTRUCTOR
+=================================================================================================*/
+
+TextureLoader::~TextureLoader()
+{
+	// Pixel buffers are freed with the GL context
+	Stop();
+}
+
+/*=================================================================================================
+  START / STOP
+=================================================================================================*/
+
+void TextureLoader::Start( int numThreads )
+{
+	Stop();
+
+	if( numThreads <= 0 )
+		numThreads = std::max( 1, (int)std::thread::hardware_concurrency() - 1 );
+
+	if( PixelBuffers[0] == 0 )
+		glGenBuffers( 2, PixelBuffers );
+
+	Stopping = false;
+	for( int i = 0; i < numThreads; i++ )
+		Workers.push_back( std::thread( &TextureLoader::WorkerMain, this ) );
+}
+
+void TextureLoader::Stop( void )
+{
+	{
+		std::lock_guard<std::mutex> lock( Mutex );
+		Stopping = true;
+	}
+	JobQueued.notify_all();
+
+	for( std::thread& worker : Workers )
+		worker.join();
+	Workers.clear();
+
+	for( Job& job : Decoded )
+		stbi_image_free( job.pixels );
+	Queued.clear();
+	Decoded.clear();
+	Requested.clear();
+	Pending = 0;
+}
+
+void TextureLoader::Delete( void )
+{
+	Stop();
+
+	if( PixelBuffers[0] != 0 )
+		glDeleteBuffers( 2, PixelBuffers );
+	PixelBuffers[0] = PixelBuffers[1] = 0;
+}
+
+/*=================================================================================================
+  LOAD
+=================================================================================================*/
+
+void TextureLoader::Load( GLuint texture, GLenum target, const std::string& path )
+{
+	Queue( Job{ texture, target, path, std::vector<unsigned char>(), nullptr, 0, 0, false, 0 } );
+}
+
+void TextureLoader::LoadEncoded( GLuint texture, GLenum target, const unsigned char* data, size_t size, const std::string& name, bool flip )
+{
+	Queue( Job{ texture, target, name, std::vector<unsigned char>( data, data + size ), nullptr, 0, 0, flip, 0 } );
+}
+
+void TextureLoader::Cancel( GLuint texture )
+{
+	// Jobs a worker is decoding right now cannot be pulled back; forgetting the request makes Update drop them
+	auto first = Requested.lower_bound( std::make_pair( texture, (GLenum)0 ) );
+	auto last = first;
+	while( last != Requested.end() && last->first.first == texture )
+		++last;
+	if( first == last )
+		return;
+	Requested.erase( first, last );
+
+	std::lock_guard<std::mutex> lock( Mutex );
+	auto cancelled = [texture]( const Job& job ) { return job.texture == texture; };
+	for( Job& job : Decoded )
+	{
+		if( cancelled( job ) )
+			stbi_image_free( job.pixels );
+	}
+
+	size_t before = Queued.size() + Decoded.size();
+	Queued.erase( std::remove_if( Queued.begin(), Queued.end(), cancelled ), Queued.end() );
+	Decoded.erase( std::remove_if( Decoded.begin(), Decoded.end(), cancelled ), Decoded.end() );
+	Pending -= (int)( before - Queued.size() - Decoded.size() );
+}
+
+void TextureLoader::Queue( Job job )
+{
+	static const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+
+	GLenum bindTarget = job.target == GL_TEXTURE_2D ? GL_TEXTURE_2D : GL_TEXTURE_CUBE_MAP;
+	glBindTexture( bindTarget, job.texture );
+	glTexImage2D( job.target, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder );
+
+	if( Pending == 0 )
+	{
+		FirstRequest = std::chrono::steady_clock::now();
+		NumUploaded = 0;
+	}
+	Pending++;
+
+	// A newer request for the same image supersedes any that is still in flight
+	job.serial = ++NextSerial;
+	Requested[std::make_pair( job.texture, job.target )] = job.serial;
+
+	{
+		std::lock_guard<std::mutex> lock( Mutex );
+		Queued.push_back( std::move( job ) );
+	}
+	JobQueued.notify_one();
+}
+
+/*=================================================================================================
+  WORKERS
+=================================================================================================*/
+
+void TextureLoader::WorkerMain( void )
+{
+	std::unique_lock<std::mutex> lock( Mutex );
+	for( ;; )
+	{
+		JobQueued.wait( lock, [this] { return Stopping || !Queued.empty(); } );
+		if( Stopping )
+			return;
+
+		Job job = std::move( Queued.front() );
+		Queued.pop_front();
+		lock.unlock();
+
+		auto start = std::chrono::steady_clock::now();
+
+		MappedFile file;
+		int channels;
+		stbi_set_flip_vertically_on_load_thread( job.flip ? 1 : 0 );
+		if( !job.encoded.empty() )
+		{
+			job.pixels = stbi_load_from_memory( job.encoded.data(), (int)job.encoded.size(), &job.width, &job.height, &channels, STBI_rgb_alpha );
+			job.encoded = std::vector<unsigned char>();
+		}
+		else if( file.Open( job.path ) && file.GetSize() > 0 )
+			job.pixels = stbi_load_from_memory( file.GetData(), (int)file.GetSize(), &job.width, &job.height, &channels, STBI_rgb_alpha );
+
+		double decodeMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+
+		lock.lock();
+		DecodeMs += decodeMs;
+		Decoded.push_back( std::move( job ) );
+		JobDecoded.notify_all();
+	}
+}
+
+/*=================================================================================================
+  UPDATE
+=================================================================================================*/
+
+int TextureLoader::Update( size_t budgetBytes )
+{
+	if( Pending == 0 )
+		return 0;
+
+	std::deque<Job> ready;
+	{
+		std::lock_guard<std::mutex> lock( Mutex );
+
+		// Take decoded images until the budget is spent, but always at least one
+		size_t bytes = 0;
+		while( !Decoded.empty() )
+		{
+			size_t size = (size_t)Decoded.front().width * Decoded.front().height * 4;
+			if( !ready.empty() && bytes + size > budgetBytes )
+				break;
+
+			bytes += size;
+			ready.push_back( std::move( Decoded.front() ) );
+			Decoded.pop_front();
+		}
+	}
+
+	for( Job& job : ready )
+	{
+		auto request = Requested.find( std::make_pair( job.texture, job.target ) );
+		if( request != Requested.end() && request->second == job.serial )
+		{
+			Requested.erase( request );
+			Upload( job );
+			NumUploaded++;
+		}
+		stbi_image_free( job.pixels );
+		Pending--;
+	}
+
+	if( !ready.empty() && Pending == 0 )
+	{
+		double residentMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - FirstRequest ).count();
+		std::lock_guard<std::mutex> lock( Mutex );
+		std::cout << "Textures: " << NumUploaded << " images resident " << residentMs << " ms after the first request ("
+			<< DecodeMs << " ms of decoding on " << Workers.size() << " workers)" << std::endl;
+	}
+
+	return (int)ready.size();
+}
+
+void TextureLoader::Finish( void )
+{
+	while( Pending > 0 )
+	{
+		{
+			std::unique_lock<std::mutex> lock( Mutex );
+			JobDecoded.wait( lock, [this] { return !Decoded.empty() || Workers.empty(); } );
+			if( Workers.empty() )
+				return;
+		}
+		Update( (size_t)-1 );
+	}
+}
+
+/*=================================================================================================
+  UPLOAD
+=================================================================================================*/
+
+void TextureLoader::Upload( Job& job )
+{
+	if( job.pixels == nullptr )
+	{
+		std::cerr << "Texture failed to load at path: " << job.path << std::endl;
+		return;
+	}
+
+	// Alternate between two buffers and orphan the one being reused, so the copy never waits for
+	// the transfer of the previous image
+	size_t size = (size_t)job.width * job.height * 4;
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, PixelBuffers[NextPixelBuffer] );
+	NextPixelBuffer = ( NextPixelBuffer + 1 ) % 2;
+	glBufferData( GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW );
+
+	void* mapped = glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT );
+	if( mapped != nullptr )
+	{
+		memcpy( mapped, job.pixels, size );
+		glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+
+		GLenum bindTarget = job.target == GL_TEXTURE_2D ? GL_TEXTURE_2D : GL_TEXTURE_CUBE_MAP;
+		glBindTexture( bindTarget, job.texture );
+		glTexImage2D( job.target, 0, GL_RGBA, job.width, job.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0 );
+	}
+
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+// Decodes images on a pool of worker threads and uploads the pixels on the GL thread through pixel
+// buffer objects, a few per frame. A texture is usable as soon as it is queued: it holds a 1x1
+// placeholder until its pixels arrive, and keeps its name afterwards.
+class TextureLoader
+{
+public:
+	TextureLoader();
+	~TextureLoader();
+
+public:
+	/**
+	Starts the worker threads and creates the pixel buffers. Call with a current GL context.
+	*@param numThreads Number of decode threads; 0 uses one less than the hardware threads.
+	**/
+	void Start( int numThreads = 0 );
+
+	// Joins the workers and drops images that were not uploaded yet
+	void Stop();
+
+	// Stop, then delete the pixel buffers
+	void Delete();
+
+	/**
+	Queues an image for decoding and gives the texture image a placeholder in the meantime.
+	*@param texture Texture name; its sampler state is left to the caller.
+	*@param target GL_TEXTURE_2D, or a cube map face of a cube map texture.
+	*@param path Path of the image file, decoded as RGBA8.
+	**/
+	void Load( GLuint texture, GLenum target, const std::string& path );
+
+	/**
+	Like Load, for an encoded image (PNG, JPEG, ...) already in memory. The bytes are copied.
+	*@param name Name used in error messages.
+	*@param flip Stores the rows bottom to top.
+	**/
+	void LoadEncoded( GLuint texture, GLenum target, const unsigned char* data, size_t size, const std::string& name, bool flip );
+
+	/**
+	Drops the images still pending for a texture. Call before deleting the texture, so a late upload
+	cannot land in a deleted name or in a new texture that was given the same name.
+	*@param texture Texture name passed to Load or LoadEncoded.
+	**/
+	void Cancel( GLuint texture );
+
+	/**
+	Uploads decoded images. Call once per frame on the GL thread.
+	*@param budgetBytes Pixel bytes that may be uploaded in this call. One image is always uploaded, so images
+	*                   larger than the budget still make progress.
+	*@return Number of images uploaded.
+	**/
+	int Update( size_t budgetBytes );
+
+	// Blocks until every queued image is resident
+	void Finish();
+
+	bool IsRunning()     const { return !Workers.empty(); }
+	int  GetNumPending() const { return Pending; }
+
+private:
+	struct Job
+	{
+		GLuint texture;
+		GLenum target;
+		std::string path;
+		std::vector<unsigned char> encoded;	// decoded instead of the file at path when not empty
+		unsigned char* pixels;
+		int width;
+		int height;
+		bool flip;
+		unsigned long long serial;	// uploaded only while it is still the latest request for its image
+	};
+
+	void Queue( Job job );
+	void WorkerMain();
+	void Upload( Job& job );
+
+private:
+	std::vector<std::thread> Workers;
+	std::mutex Mutex;
+	std::condition_variable JobQueued;
+	std::condition_variable JobDecoded;
+	std::deque<Job> Queued;		// waiting for a worker
+	std::deque<Job> Decoded;	// waiting for the GL thread
+	bool Stopping;
+
+	// Touched by the GL thread only
+	std::map<std::pair<GLuint, GLenum>, unsigned long long> Requested;	// texture and target -> serial of the current job
+	unsigned long long NextSerial;
+	int Pending;
+	GLuint PixelBuffers[2];
+	int NextPixelBuffer;
+	int NumUploaded;
+	std::chrono::steady_clock::time_point FirstRequest;
+	double DecodeMs;	// summed over workers, guarded by Mutex
+};
@@ -0,0 +1,237 @@
+#include "texturemanager.h"
+#include "stb_image.h"
+#include <iostream>
+#include <vector>
+#include <cstring>
+
+/*=================================================================================================
+  CONSTRUCTORS
+=================================================================================================*/
+
+TextureManager::TextureManager()
+{
+	Requests = 0;
+	Loads = 0;
+	Loader = nullptr;
+	Archive = nullptr;
+}
+
+/*=================================================================================================
+  DESTRUCTOR
+=================================================================================================*/
+
+TextureManager::~TextureManager()
+{
+	// Textures still referenced here are freed with the GL context
+	IDs.clear();
+	Entries.clear();
+}
+
+/*=================================================================================================
+  ACQUIRE
+=================================================================================================*/
+
+GLuint TextureManager::Acquire( const std::string& path, const TextureSampler& sampler )
+{
+	Requests++;
+
+	std::string key = MakeKey( path, sampler );
+	GLuint id = Find( key );
+	if( id != 0 )
+		return id;
+
+	return Insert( key, Load( path, sampler ) );
+}
+
+GLuint TextureManager::AcquireEncoded( const std::string& name, const unsigned char* data, size_t size, bool flip, const TextureSampler& sampler )
+{
+	Requests++;
+
+	std::string key = MakeKey( name, sampler );
+	GLuint id = Find( key );
+	if( id != 0 )
+		return id;
+
+	return Insert( key, LoadEncoded( name, data, size, flip, sampler ) );
+}
+
+GLuint TextureManager::AcquirePixels( const std::string& name, const void* pixels, int width, int height, GLenum format, bool flip, const TextureSampler& sampler )
+{
+	Requests++;
+
+	std::string key = MakeKey( name, sampler );
+	GLuint id = Find( key );
+	if( id != 0 )
+		return id;
+
+	Loads++;
+
+	std::vector<unsigned char> flipped;
+	if( flip )
+	{
+		size_t rowSize = (size_t)width * 4;
+		const unsigned char* rows = (const unsigned char*)pixels;
+		flipped.resize( rowSize * height );
+		for( int y = 0; y < height; y++ )
+			memcpy( &flipped[(size_t)y * rowSize], rows + (size_t)( height - 1 - y ) * rowSize, rowSize );
+		pixels = flipped.data();
+	}
+
+	GLuint textureID = CreateTexture( sampler );
+	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, format, GL_UNSIGNED_BYTE, pixels );
+
+	return Insert( key, textureID );
+}
+
+std::string TextureManager::MakeKey( const std::string& name, const TextureSampler& sampler )
+{
+	return name + "|" + std::to_string( sampler.wrap ) + "|" + std::to_string( sampler.minFilter ) + "|" + std::to_string( sampler.magFilter );
+}
+
+// Adds a reference to a cached texture; 0 if the key is not cached
+GLuint TextureManager::Find( const std::string& key )
+{
+	auto it = IDs.find( key );
+	if( it == IDs.end() )
+		return 0;
+
+	Entries[it->second].refCount++;
+	return it->second;
+}
+
+GLuint TextureManager::Insert( const std::string& key, GLuint id )
+{
+	if( id == 0 )
+		return 0;
+
+	IDs[key] = id;
+	Entries[id] = Entry{ key, 1 };
+
+	return id;
+}
+
+/*=================================================================================================
+  RELEASE
+=================================================================================================*/
+
+void TextureManager::Release( GLuint id )
+{
+	auto it = Entries.find( id );
+	if( it == Entries.end() )
+		return;
+
+	if( --it->second.refCount > 0 )
+		return;
+
+	if( Loader != nullptr )
+		Loader->Cancel( id );
+	glDeleteTextures( 1, &id );
+	IDs.erase( it->second.key );
+	Entries.erase( it );
+}
+
+/*=================================================================================================
+  CLEAR
+=================================================================================================*/
+
+void TextureManager::Clear( void )
+{
+	for( auto& entry : Entries )
+	{
+		if( Loader != nullptr )
+			Loader->Cancel( entry.first );
+		glDeleteTextures( 1, &entry.first );
+	}
+
+	IDs.clear();
+	Entries.clear();
+}
+
+/*=================================================================================================
+  LOAD
+=================================================================================================*/
+
+GLuint TextureManager::Load( const std::string& path, const TextureSampler& sampler )
+{
+	size_t size;
+	const unsigned char* cooked = Archive != nullptr ? Archive->Find( path, ASSET_TEXTURE, size ) : nullptr;
+	if( cooked != nullptr )
+	{
+		GLuint textureID = CreateTexture( sampler );
+		if( UploadCookedTexture( GL_TEXTURE_2D, cooked, size ) )
+		{
+			Loads++;
+			return textureID;
+		}
+		glDeleteTextures( 1, &textureID );
+	}
+
+	if( Loader != nullptr && Loader->IsRunning() )
+	{
+		GLuint textureID = CreateTexture( sampler );
+		Loader->Load( textureID, GL_TEXTURE_2D, path );
+		Loads++;
+		return textureID;
+	}
+
+	int width, height, nrChannels;
+	unsigned char* data = stbi_load( path.c_str(), &width, &height, &nrChannels, STBI_rgb_alpha );
+	if( data == NULL )
+	{
+		std::cerr << "Texture failed to load at path: " << path << std::endl;
+		return 0;
+	}
+
+	Loads++;
+
+	GLuint textureID = CreateTexture( sampler );
+	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data );
+
+	stbi_image_free( data );
+
+	return textureID;
+}
+
+GLuint TextureManager::LoadEncoded( const std::string& name, const unsigned char* data, size_t size, bool flip, const TextureSampler& sampler )
+{
+	if( Loader != nullptr && Loader->IsRunning() )
+	{
+		GLuint textureID = CreateTexture( sampler );
+		Loader->LoadEncoded( textureID, GL_TEXTURE_2D, data, size, name, flip );
+		Loads++;
+		return textureID;
+	}
+
+	int width, height, nrChannels;
+	stbi_set_flip_vertically_on_load_thread( flip ? 1 : 0 );
+	unsigned char* pixels = stbi_load_from_memory( data, (int)size, &width, &height, &nrChannels, STBI_rgb_alpha );
+	stbi_set_flip_vertically_on_load_thread( 0 );
+	if( pixels == NULL )
+	{
+		std::cerr << "Texture failed to load from memory: " << name << std::endl;
+		return 0;
+	}
+
+	Loads++;
+
+	GLuint textureID = CreateTexture( sampler );
+	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels );
+
+	stbi_image_free( pixels );
+
+	return textureID;
+}
+
+// Generates a texture with the sampler state and leaves it bound to GL_TEXTURE_2D
+GLuint TextureManager::CreateTexture( const TextureSampler& sampler )
+{
+	GLuint textureID;
+	glGenTextures( 1, &textureID );
+	glBindTexture( GL_TEXTURE_2D, textureID );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrap );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrap );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampler.minFilter );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler.magFilter );
+
+	return textureID;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/freeglut.h>
+#include <string>
+#include <map>
+#include "textureloader.h"
+#include "assetarchive.h"
+
+// Sampler state a texture is created with; part of the cache key
+struct TextureSampler
+{
+	GLint wrap      = GL_REPEAT;
+	GLint minFilter = GL_NEAREST;
+	GLint magFilter = GL_NEAREST;
+};
+
+class TextureManager
+{
+public:
+	TextureManager();
+	~TextureManager();
+
+public:
+	/**
+	Returns a 2D texture for the image at path, decoding and uploading it only the first time
+	the (path, sampler) pair is requested. Every Acquire must be matched by a Release.
+	*@param path Path of the image file.
+	*@param sampler Wrap and filter modes of the texture.
+	*@return Texture handle, or 0 if the image could not be loaded.
+	**/
+	GLuint Acquire( const std::string& path, const TextureSampler& sampler = TextureSampler() );
+
+	/**
+	Like Acquire, for an encoded image (PNG, JPEG, ...) that is already in memory, such as one embedded in a model.
+	*@param name Cache key standing in for the path, e.g. "models/player.glb*0".
+	*@param data Encoded bytes; only read during the call.
+	*@param size Number of bytes.
+	*@param flip Stores the rows bottom to top, for texture coordinates that were flipped on import.
+	**/
+	GLuint AcquireEncoded( const std::string& name, const unsigned char* data, size_t size, bool flip, const TextureSampler& sampler = TextureSampler() );
+
+	/**
+	Like Acquire, for 8-bit RGBA or BGRA texels that are already in memory; they are uploaded immediately.
+	*@param name Cache key standing in for the path.
+	*@param format GL_RGBA or GL_BGRA.
+	*@param flip Stores the rows bottom to top.
+	**/
+	GLuint AcquirePixels( const std::string& name, const void* pixels, int width, int height, GLenum format, bool flip, const TextureSampler& sampler = TextureSampler() );
+
+	/**
+	Drops one reference to a texture returned by Acquire and deletes it after the last one.
+	*@param id Texture handle.
+	**/
+	void Release( GLuint id );
+
+	void Clear();
+
+	// Hands decoding and uploading of new textures to a running loader; they start out as placeholders
+	void SetLoader( TextureLoader* loader ) { Loader = loader; }
+
+	// Takes images that are current in the archive from there, already decoded and with mips; nullptr loads from disk
+	void SetArchive( const AssetArchive* archive ) { Archive = archive; }
+
+public:
+	int GetNumTextures() const { return (int)Entries.size(); }
+	int GetNumRequests() const { return Requests; }
+	int GetNumLoads()    const { return Loads;    }
+
+private:
+	struct Entry
+	{
+		std::string key;
+		int refCount;
+	};
+
+	static std::string MakeKey( const std::string& name, const TextureSampler& sampler );
+	GLuint Find( const std::string& key );
+	GLuint Insert( const std::string& key, GLuint id );
+	GLuint Load( const std::string& path, const TextureSampler& sampler );
+	GLuint LoadEncoded( const std::string& name, const unsigned char* data, size_t size, bool flip, const TextureSampler& sampler );
+	GLuint CreateTexture( const TextureSampler& sampler );
+
+private:
+	std::map<std::string, GLuint> IDs;	// cache key -> texture
+	std::map<GLuint, Entry> Entries;	// texture -> key and reference count
+	int Requests;
+	int Loads;
+	TextureLoader* Loader;
+	const AssetArchive* Archive;
+};
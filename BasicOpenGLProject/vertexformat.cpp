@@ -0,0 +1,182 @@
+#include "vertexformat.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+/*=================================================================================================
+  CONSTRUCTORS
+=================================================================================================*/
+
+VertexFormat::VertexFormat( bool skinned, bool halfPositions, bool octNormals )
+{
+	Skinned = skinned;
+	HalfPositions = halfPositions;
+	OctNormals = octNormals;
+
+	// Every attribute starts on a 4-byte boundary; half positions carry two bytes of padding
+	NormalOffset   = HalfPositions ? 8 : 12;
+	TexCoordOffset = NormalOffset + ( OctNormals ? 4 : 12 );
+	BoneIdOffset   = TexCoordOffset + 8;
+	WeightOffset   = BoneIdOffset + 4;
+	Stride         = Skinned ? WeightOffset + 8 : BoneIdOffset;
+}
+
+/*=================================================================================================
+  PACK
+=================================================================================================*/
+
+void VertexFormat::Pack( unsigned char* dst, const glm::vec3& position, const glm::vec3& normal, const glm::vec2& texCoord, const int* boneIds, const float* weights ) const
+{
+	memset( dst, 0, Stride );
+
+	if( HalfPositions )
+	{
+		unsigned short half[3] = { FloatToHalf( position.x ), FloatToHalf( position.y ), FloatToHalf( position.z ) };
+		memcpy( dst, half, sizeof( half ) );
+	}
+	else
+		memcpy( dst, &position[0], 3 * sizeof( float ) );
+
+	if( OctNormals )
+	{
+		short oct[2];
+		OctEncode( normal, oct );
+		memcpy( dst + NormalOffset, oct, sizeof( oct ) );
+	}
+	else
+		memcpy( dst + NormalOffset, &normal[0], 3 * sizeof( float ) );
+
+	memcpy( dst + TexCoordOffset, &texCoord[0], 2 * sizeof( float ) );
+
+	if( !Skinned )
+		return;
+
+	// Unused slots become bone 255 with zero weight; ids past 255 saturate so the shader treats them as invalid
+	unsigned char ids[4] = { 255, 255, 255, 255 };
+	unsigned short packedWeights[4] = { 0, 0, 0, 0 };
+	for( int i = 0; i < 4; i++ )
+	{
+		if( boneIds[i] < 0 || weights[i] <= 0.0f )
+			continue;
+
+		ids[i] = (unsigned char)std::min( boneIds[i], 255 );
+		packedWeights[i] = (unsigned short)std::lround( std::min( weights[i], 1.0f ) * 65535.0f );
+	}
+	memcpy( dst + BoneIdOffset, ids, sizeof( ids ) );
+	memcpy( dst + WeightOffset, packedWeights, sizeof( packedWeights ) );
+}
+
+/*=================================================================================================
+  ATTRIBUTES
+=================================================================================================*/
+
+void VertexFormat::SetAttributes( void ) const
+{
+	GLsizei stride = (GLsizei)Stride;
+
+	glEnableVertexAttribArray( 0 );
+	if( HalfPositions )
+		glVertexAttribPointer( 0, 3, GL_HALF_FLOAT, GL_FALSE, stride, (void*)0 );
+	else
+		glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0 );
+
+	// Octahedral normals are read as plain shorts and scaled in the shader, which sidesteps the
+	// pre-4.2 snorm conversion that cannot represent zero
+	glEnableVertexAttribArray( 1 );
+	if( OctNormals )
+		glVertexAttribPointer( 1, 2, GL_SHORT, GL_FALSE, stride, (void*)NormalOffset );
+	else
+		glVertexAttribPointer( 1, 3, GL_FLOAT, GL_FALSE, stride, (void*)NormalOffset );
+
+	glEnableVertexAttribArray( 2 );
+	glVertexAttribPointer( 2, 2, GL_FLOAT, GL_FALSE, stride, (void*)TexCoordOffset );
+
+	if( Skinned )
+	{
+		glEnableVertexAttribArray( 3 );
+		glVertexAttribIPointer( 3, 4, GL_UNSIGNED_BYTE, stride, (void*)BoneIdOffset );
+		glEnableVertexAttribArray( 4 );
+		glVertexAttribPointer( 4, 4, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)WeightOffset );
+	}
+	else
+	{
+		// Static meshes read the generic values instead: no bones, zero weight, so they are drawn unskinned
+		glDisableVertexAttribArray( 3 );
+		glDisableVertexAttribArray( 4 );
+		glVertexAttribI4ui( 3, 255, 255, 255, 255 );
+		glVertexAttrib4f( 4, 0.0f, 0.0f, 0.0f, 0.0f );
+	}
+}
+
+/*=================================================================================================
+  ENCODING
+=================================================================================================*/
+
+unsigned short VertexFormat::FloatToHalf( float value )
+{
+	unsigned int bits;
+	memcpy( &bits, &value, sizeof( bits ) );
+
+	unsigned short sign = (unsigned short)( ( bits >> 16 ) & 0x8000 );
+	int exponent = (int)( ( bits >> 23 ) & 0xff ) - 127 + 15;
+	unsigned int mantissa = bits & 0x7fffff;
+
+	// Too large (or not finite): infinity
+	if( exponent >= 31 )
+		return sign | 0x7c00;
+
+	// Too small for a normal half: denormal or zero, rounded to nearest
+	if( exponent <= 0 )
+	{
+		if( exponent < -10 )
+			return sign;
+
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		unsigned int half = mantissa >> shift;
+		if( ( mantissa >> ( shift - 1 ) ) & 1 )
+			half++;
+		return sign | (unsigned short)half;
+	}
+
+	// Round to nearest; a carry out of the mantissa correctly bumps the exponent
+	unsigned int half = ( (unsigned int)exponent << 10 ) | ( mantissa >> 13 );
+	if( mantissa & 0x1000 )
+		half++;
+	return sign | (unsigned short)std::min( half, 0x7c00u );
+}
+
+void VertexFormat::OctEncode( const glm::vec3& normal, short* out )
+{
+	float length = std::fabs( normal.x ) + std::fabs( normal.y ) + std::fabs( normal.z );
+	if( length == 0.0f )
+	{
+		out[0] = out[1] = 0;
+		return;
+	}
+
+	float x = normal.x / length;
+	float y = normal.y / length;
+	if( normal.z < 0.0f )
+	{
+		float foldedX = ( 1.0f - std::fabs( y ) ) * ( x >= 0.0f ? 1.0f : -1.0f );
+		float foldedY = ( 1.0f - std::fabs( x ) ) * ( y >= 0.0f ? 1.0f : -1.0f );
+		x = foldedX;
+		y = foldedY;
+	}
+
+	out[0] = (short)std::lround( glm::clamp( x, -1.0f, 1.0f ) * 32767.0f );
+	out[1] = (short)std::lround( glm::clamp( y, -1.0f, 1.0f ) * 32767.0f );
+}
+
+bool VertexFormat::HalfPositionsFit( const glm::vec3& lo, const glm::vec3& hi )
+{
+	glm::vec3 magnitude = glm::max( glm::abs( lo ), glm::abs( hi ) );
+	float largest = std::max( magnitude.x, std::max( magnitude.y, magnitude.z ) );
+	float size = glm::length( hi - lo );
+
+	// Rounding error of a half is at most 2^-11 of the value. Cap it in absolute terms too: meshes placed in
+	// world space, such as the level batch, must line up with their collision bounds.
+	float error = largest / 2048.0f;
+	return size > 0.0f && largest < 65504.0f && error <= size / 2000.0f && error <= 1e-3f;
+}
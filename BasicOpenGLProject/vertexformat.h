@@ -0,0 +1,55 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+
+// Packed vertex layouts. Static meshes drop the bone data; skinned meshes keep four uint8 bone ids and
+// unorm16 weights. Either can store positions as half floats and normals octahedral-encoded in two shorts
+// (the shaders decode those when OCTAHEDRAL_NORMALS is defined). Texture coordinates stay full floats so
+// tiled UVs keep their precision.
+class VertexFormat
+{
+public:
+	VertexFormat( bool skinned, bool halfPositions, bool octNormals );
+
+public:
+	/**
+	Writes one vertex at dst, which must have room for GetStride() bytes.
+	*@param boneIds Four bone ids, ignored for static layouts. Slots with a negative id or zero weight are unused.
+	*               They are stored as unsigned bytes, with 255 for unused slots.
+	*@param weights Four bone weights, ignored for static layouts.
+	**/
+	void Pack( unsigned char* dst, const glm::vec3& position, const glm::vec3& normal, const glm::vec2& texCoord, const int* boneIds, const float* weights ) const;
+
+	// Points attributes 0-4 of the bound vertex array at the bound GL_ARRAY_BUFFER
+	void SetAttributes() const;
+
+	size_t GetStride() const { return Stride;  }
+	bool   IsSkinned() const { return Skinned; }
+
+public:
+	static unsigned short FloatToHalf( float value );
+
+	// Maps a unit normal onto the octahedron and folds it into [-1,1]^2, quantized to shorts
+	static void OctEncode( const glm::vec3& normal, short* out );
+
+	/**
+	Half floats keep 11 significant bits, so they only suit small meshes modelled around their own origin.
+	*@param lo Minimum corner of the mesh bounds.
+	*@param hi Maximum corner of the mesh bounds.
+	*@return True if rounding to half floats moves no vertex by more than 1/2000 of the mesh size, nor by more than 0.001 units.
+	**/
+	static bool HalfPositionsFit( const glm::vec3& lo, const glm::vec3& hi );
+
+private:
+	bool Skinned;
+	bool HalfPositions;
+	bool OctNormals;
+
+	size_t Stride;
+	size_t NormalOffset;
+	size_t TexCoordOffset;
+	size_t BoneIdOffset;
+	size_t WeightOffset;
+};